@@ -0,0 +1,160 @@
+#ifndef AIGER_HH
+#define AIGER_HH
+
+/*
+ * And-inverter graphs, written in the binary AIGER format (--aiger).
+ *
+ * Literals follow the AIGER convention: 0 is false, 1 is true, variable v
+ * is literal 2v and its negation 2v + 1. Inputs are variables 1 to
+ * nr_inputs and every and-gate gets the next variable when it is created,
+ * so the gates are numbered in a topological order as the format requires.
+ * Gates are folded (x & 0 = 0, x & x = x, x & ~x = 0, ...) and hashed, so
+ * an and-gate with the same inputs is only created once.
+ *
+ * See <https://fmv.jku.at/aiger/FORMAT> for the file format.
+ */
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class aig {
+public:
+	aig(unsigned int nr_inputs):
+		nr_inputs(nr_inputs)
+	{
+	}
+
+	unsigned int input(unsigned int i) const
+	{
+		return 2 * (i + 1);
+	}
+
+	unsigned int and_gate(unsigned int a, unsigned int b)
+	{
+		if (a < b)
+			std::swap(a, b);
+
+		if (b == 0 || a == (b ^ 1))
+			return 0;
+		if (b == 1 || a == b)
+			return a;
+
+		uint64_t key = (uint64_t) a << 32 | b;
+		auto it = hash.find(key);
+		if (it != hash.end())
+			return it->second;
+
+		ands.push_back(std::make_pair(a, b));
+		unsigned int r = 2 * (nr_inputs + ands.size());
+		hash[key] = r;
+		return r;
+	}
+
+	unsigned int or_gate(unsigned int a, unsigned int b)
+	{
+		return and_gate(a ^ 1, b ^ 1) ^ 1;
+	}
+
+	unsigned int xor_gate(unsigned int a, unsigned int b)
+	{
+		return or_gate(and_gate(a, b ^ 1), and_gate(a ^ 1, b));
+	}
+
+	/* c ? a : b */
+	unsigned int mux(unsigned int c, unsigned int a, unsigned int b)
+	{
+		return or_gate(and_gate(c, a), and_gate(c ^ 1, b));
+	}
+
+	unsigned int maj(unsigned int a, unsigned int b, unsigned int c)
+	{
+		return or_gate(and_gate(a, b), and_gate(c, or_gate(a, b)));
+	}
+
+	void add_output(unsigned int lit, const std::string &name)
+	{
+		outputs.push_back(std::make_pair(lit, name));
+	}
+
+	unsigned int nr_ands() const
+	{
+		return ands.size();
+	}
+
+	/* The value of each output for the given input values */
+	std::vector<bool> evaluate(const std::vector<bool> &inputs) const
+	{
+		if (inputs.size() != nr_inputs)
+			throw std::runtime_error("aig: wrong number of inputs");
+
+		std::vector<bool> values(1 + nr_inputs + ands.size());
+		for (unsigned int i = 0; i < nr_inputs; ++i)
+			values[1 + i] = inputs[i];
+
+		auto value = [&](unsigned int lit) -> bool {
+			return values[lit / 2] ^ (lit & 1);
+		};
+
+		for (unsigned int i = 0; i < ands.size(); ++i)
+			values[1 + nr_inputs + i] = value(ands[i].first) && value(ands[i].second);
+
+		std::vector<bool> result;
+		for (const auto &it: outputs)
+			result.push_back(value(it.first));
+
+		return result;
+	}
+
+	/* input_names has one name per input for the symbol table; comments
+	 * go in the comment section at the end */
+	void write(std::ostream &out, const std::vector<std::string> &input_names, const std::vector<std::string> &comments) const
+	{
+		out << "aig " << nr_inputs + ands.size() << " " << nr_inputs << " 0 "
+			<< outputs.size() << " " << ands.size() << "\n";
+
+		for (const auto &it: outputs)
+			out << it.first << "\n";
+
+		/* Each gate is the difference between its variable and the
+		 * larger input, then between the two inputs, in 7-bit groups */
+		for (unsigned int i = 0; i < ands.size(); ++i) {
+			unsigned int lhs = 2 * (nr_inputs + i + 1);
+			write_delta(out, lhs - ands[i].first);
+			write_delta(out, ands[i].first - ands[i].second);
+		}
+
+		for (unsigned int i = 0; i < input_names.size(); ++i)
+			out << "i" << i << " " << input_names[i] << "\n";
+		for (unsigned int i = 0; i < outputs.size(); ++i)
+			out << "o" << i << " " << outputs[i].second << "\n";
+
+		if (!comments.empty()) {
+			out << "c\n";
+			for (const std::string &s: comments)
+				out << s << "\n";
+		}
+	}
+
+private:
+	unsigned int nr_inputs;
+	std::vector<std::pair<unsigned int, unsigned int>> ands;
+	std::unordered_map<uint64_t, unsigned int> hash;
+	std::vector<std::pair<unsigned int, std::string>> outputs;
+
+	static void write_delta(std::ostream &out, unsigned int x)
+	{
+		while (x & ~0x7f) {
+			out.put((x & 0x7f) | 0x80);
+			x >>= 7;
+		}
+
+		out.put(x);
+	}
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef ANF_HH
+#define ANF_HH
+
+/*
+ * Polynomials over GF(2) in algebraic normal form, for --anf.
+ *
+ * A polynomial is a set of monomials and a monomial is a sorted list of
+ * variables; the empty monomial is 1. Since x * x = x and x + x = 0, a
+ * variable occurs at most once in a monomial and adding two polynomials
+ * is the symmetric difference of their monomials.
+ *
+ * Polynomials are written one per line in the format read by Bosphorus
+ * and similar tools, e.g. "x(1)*x(2) + x(3) + 1", and each line means
+ * that the polynomial is 0.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+typedef std::vector<int> anf_monomial;
+typedef std::set<anf_monomial> anf_polynomial;
+
+static inline anf_polynomial anf_constant(bool value)
+{
+	anf_polynomial p;
+	if (value)
+		p.insert(anf_monomial());
+	return p;
+}
+
+/* x, or x + 1 for -x */
+static inline anf_polynomial anf_literal(int x)
+{
+	anf_polynomial p;
+	p.insert(anf_monomial(1, abs(x)));
+	if (x < 0)
+		p.insert(anf_monomial());
+	return p;
+}
+
+static inline void anf_add(anf_polynomial &p, const anf_polynomial &q)
+{
+	for (const anf_monomial &m: q) {
+		auto it = p.find(m);
+		if (it == p.end())
+			p.insert(m);
+		else
+			p.erase(it);
+	}
+}
+
+static inline anf_polynomial anf_multiply(const anf_polynomial &p, const anf_polynomial &q)
+{
+	anf_polynomial r;
+	for (const anf_monomial &a: p) {
+		for (const anf_monomial &b: q) {
+			anf_monomial m;
+			std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(m));
+			anf_add(r, anf_polynomial{m});
+		}
+	}
+
+	return r;
+}
+
+/* Monomials of higher degree first */
+static inline std::string anf_string(const anf_polynomial &p)
+{
+	std::vector<anf_monomial> monomials(p.begin(), p.end());
+	std::stable_sort(monomials.begin(), monomials.end(), [](const anf_monomial &a, const anf_monomial &b) {
+		return a.size() > b.size();
+	});
+
+	std::string s;
+	for (const anf_monomial &m: monomials) {
+		if (!s.empty())
+			s += " + ";
+
+		if (m.empty()) {
+			s += "1";
+			continue;
+		}
+
+		for (unsigned int i = 0; i < m.size(); ++i) {
+			if (i)
+				s += "*";
+			s += "x(" + std::to_string(m[i]) + ")";
+		}
+	}
+
+	return s;
+}
+
+template<typename F>
+static inline bool anf_evaluate(const anf_polynomial &p, F value)
+{
+	bool r = false;
+	for (const anf_monomial &m: p) {
+		bool product = true;
+		for (int x: m)
+			product = product && value(x);
+		r ^= product;
+	}
+
+	return r;
+}
+
+#endif
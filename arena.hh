@@ -0,0 +1,120 @@
+#ifndef ARENA_HH
+#define ARENA_HH
+
+/*
+ * Layout of the shared-memory clause arena.
+ *
+ * With --shm-solver, the generator places the finished clause database in
+ * a sealed memfd and runs the solver with the file descriptor number in
+ * the SHA1_SAT_FD environment variable. A solver that includes this header
+ * can map the segment read-only and load the clauses without parsing or
+ * copying anything:
+ *
+ *     const arena_header *h = arena_map(atoi(getenv("SHA1_SAT_FD")));
+ *
+ *     for (uint64_t i = 0; i < h->nr_clauses; ++i) {
+ *         const int32_t *begin = arena_clause_begin(h, i);
+ *         const int32_t *end = arena_clause_end(h, i);
+ *         ...
+ *     }
+ *
+ * Literals use the DIMACS convention (variable numbers starting at 1,
+ * negative for negated literals) but clauses are not 0-terminated; the
+ * offset table has nr_clauses + 1 entries so that clause i occupies
+ * literals[offsets[i]] up to (but not including) literals[offsets[i + 1]].
+ *
+ * The label table carries the same information as the "c var" comments
+ * of a CNF file; names are 0-terminated strings in the string pool.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+extern "C" {
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+#define ARENA_MAGIC "SHA1SAT"
+#define ARENA_VERSION 1
+
+struct arena_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+
+	uint64_t size;
+
+	uint64_t nr_variables;
+	uint64_t nr_clauses;
+	uint64_t nr_literals;
+	uint64_t nr_labels;
+
+	/* Byte offsets from the start of the segment */
+	uint64_t offsets_offset;
+	uint64_t literals_offset;
+	uint64_t labels_offset;
+	uint64_t strings_offset;
+};
+
+struct arena_label {
+	int32_t first;
+	uint32_t width;
+	uint64_t name;
+};
+
+static inline const uint64_t *arena_offsets(const arena_header *h)
+{
+	return (const uint64_t *) ((const char *) h + h->offsets_offset);
+}
+
+static inline const int32_t *arena_literals(const arena_header *h)
+{
+	return (const int32_t *) ((const char *) h + h->literals_offset);
+}
+
+static inline const arena_label *arena_labels(const arena_header *h)
+{
+	return (const arena_label *) ((const char *) h + h->labels_offset);
+}
+
+static inline const char *arena_label_name(const arena_header *h, const arena_label *l)
+{
+	return (const char *) h + h->strings_offset + l->name;
+}
+
+static inline const int32_t *arena_clause_begin(const arena_header *h, uint64_t i)
+{
+	return arena_literals(h) + arena_offsets(h)[i];
+}
+
+static inline const int32_t *arena_clause_end(const arena_header *h, uint64_t i)
+{
+	return arena_literals(h) + arena_offsets(h)[i + 1];
+}
+
+/* Map an arena read-only; returns NULL if fd does not refer to a valid
+ * arena of a version we understand. */
+static inline const arena_header *arena_map(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (uint64_t) st.st_size < sizeof(arena_header))
+		return NULL;
+
+	void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	const arena_header *h = (const arena_header *) p;
+	if (memcmp(h->magic, ARENA_MAGIC, sizeof(ARENA_MAGIC))
+		|| h->version != ARENA_VERSION
+		|| h->size != (uint64_t) st.st_size)
+	{
+		munmap(p, st.st_size);
+		return NULL;
+	}
+
+	return h;
+}
+
+#endif
@@ -0,0 +1,392 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark the generator.
+ *
+ * Runs the generator for every combination of output format (including
+ * --null, which encodes but discards the instance), attack, number of
+ * rounds and encoding flags, and reports the speed and memory use of
+ * each as JSON. The generator is run as a separate process so that peak
+ * RSS is per instance; allocations come from its --usage-report.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+extern "C" {
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include "format.hh"
+#include "solution.hh"
+
+#define MIN_COMPARED_SECONDS 0.02
+
+struct bench_case {
+	std::string output;
+	std::string attack;
+	unsigned int nr_rounds;
+	std::vector<std::string> flags;
+
+	std::string name() const
+	{
+		std::string r = format("$/$/$/", output, attack, nr_rounds);
+		if (flags.empty())
+			return r + "plain";
+
+		for (unsigned int i = 0; i < flags.size(); ++i)
+			r += (i ? "+" : "") + flags[i];
+
+		return r;
+	}
+};
+
+struct bench_result {
+	double seconds;
+	unsigned long bytes;
+	unsigned long allocations;
+	unsigned long max_rss_kb;
+};
+
+/* Encoding flags that make a difference for each format */
+static std::vector<std::string> format_flags(const std::string &f)
+{
+	if (f == "cnf")
+		return {"xor", "halfadder", "tseitin-adders"};
+	if (f == "opb")
+		return {"tseitin-adders", "compact-adders"};
+	if (f == "null")
+		return {"xor", "halfadder", "tseitin-adders", "compact-adders"};
+
+	throw std::runtime_error(format("unknown format $", f));
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static unsigned long read_usage_report(const std::string &filename)
+{
+	mapped_file f(filename);
+	return json_uint_field(f.begin(), f.end(), "allocations");
+}
+
+/* Run the generator once, reading (and discarding) its output */
+static bench_result run(const std::string &generator, const bench_case &c,
+	unsigned long seed, const std::string &usage_report)
+{
+	std::vector<std::string> args = {
+		generator,
+		format("--$", c.output),
+		format("--attack=$", c.attack),
+		format("--rounds=$", c.nr_rounds),
+		format("--seed=$", seed),
+		format("--usage-report=$", usage_report),
+	};
+
+	for (const std::string &flag: c.flags)
+		args.push_back(format("--$", flag));
+
+	std::vector<char *> argv;
+	for (std::string &arg: args)
+		argv.push_back(&arg[0]);
+	argv.push_back(0);
+
+	int fds[2];
+	if (pipe(fds) == -1)
+		throw std::runtime_error("pipe() failed");
+
+	auto start = std::chrono::steady_clock::now();
+
+	pid_t child = fork();
+	if (child == -1)
+		throw std::runtime_error("fork() failed");
+
+	if (child == 0) {
+		close(fds[0]);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[1]);
+
+		execv(argv[0], &argv[0]);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	close(fds[1]);
+
+	bench_result r;
+	r.bytes = 0;
+
+	static char buf[1 << 16];
+	while (true) {
+		ssize_t len = read(fds[0], buf, sizeof(buf));
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		r.bytes += len;
+	}
+
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if (wait4(child, &status, 0, &usage) == -1)
+		throw std::runtime_error("wait4() failed");
+
+	r.seconds = seconds_since(start);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		throw std::runtime_error(format("$ failed", c.name()));
+
+	r.max_rss_kb = usage.ru_maxrss;
+	r.allocations = read_usage_report(usage_report);
+	return r;
+}
+
+static double json_double_field(const char *p, const char *end, const char *key)
+{
+	const char *q = json_field(p, end, key);
+	if (!q)
+		throw std::runtime_error(format("malformed baseline (expected \"$\")", key));
+
+	return strtod(q, 0);
+}
+
+/* Results from an earlier run, by name */
+static std::map<std::string, bench_result> read_baseline(const std::string &filename)
+{
+	std::map<std::string, bench_result> results;
+
+	mapped_file f(filename);
+	for (const char *p = f.begin(); p != f.end(); ) {
+		const char *line = p;
+		p = skip_line(p, f.end());
+
+		if (!json_field(line, p, "name"))
+			continue;
+
+		bench_result r;
+		r.seconds = json_double_field(line, p, "seconds");
+		r.bytes = json_uint_field(line, p, "bytes");
+		r.allocations = json_uint_field(line, p, "allocations");
+		r.max_rss_kb = json_uint_field(line, p, "max_rss_kb");
+		results[json_string_field(line, p, "name")] = r;
+	}
+
+	return results;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string generator = "./main";
+	std::vector<std::string> formats;
+	std::vector<std::string> attacks;
+	std::vector<unsigned int> rounds;
+	unsigned int nr_repeats = 3;
+	unsigned long seed = 1;
+	std::string output;
+	std::string baseline;
+	double tolerance = 0.1;
+
+	{
+		using namespace boost::program_options;
+
+		options_description options("Options");
+		options.add_options()
+			("help,h", "Display this information")
+			("generator", value<std::string>(&generator), "Path to the generator")
+			("format", value<std::vector<std::string>>(&formats), "Output format (null, cnf, opb); default all")
+			("attack", value<std::vector<std::string>>(&attacks), "Attack type; default all")
+			("rounds", value<std::vector<unsigned int>>(&rounds), "Number of rounds; default 16, 24, ..., 80")
+			("repeat", value<unsigned int>(&nr_repeats), "Run each case this many times and keep the fastest")
+			("seed", value<unsigned long>(&seed), "Random number seed passed to the generator")
+			("output", value<std::string>(&output), "Write the JSON results to this file instead of standard output")
+			("baseline", value<std::string>(&baseline), "Compare against the results of an earlier run")
+			("tolerance", value<double>(&tolerance), "Relative change allowed before a case counts as a regression")
+		;
+
+		variables_map map;
+		store(parse_command_line(argc, argv, options), map);
+		notify(map);
+
+		if (map.count("help")) {
+			std::cout << options;
+			return 0;
+		}
+	}
+
+	if (formats.empty())
+		formats = {"null", "cnf", "opb"};
+	if (attacks.empty())
+		attacks = {"preimage", "second-preimage", "collision"};
+	if (rounds.empty()) {
+		for (unsigned int i = 16; i <= 80; i += 8)
+			rounds.push_back(i);
+	}
+
+	if (!nr_repeats)
+		nr_repeats = 1;
+
+	std::vector<bench_case> cases;
+	try {
+		for (const std::string &f: formats) {
+			std::vector<std::string> flags = format_flags(f);
+
+			for (const std::string &attack: attacks) {
+				for (unsigned int nr_rounds: rounds) {
+					for (unsigned int mask = 0; mask < (1U << flags.size()); ++mask) {
+						bench_case c;
+						c.output = f;
+						c.attack = attack;
+						c.nr_rounds = nr_rounds;
+
+						for (unsigned int i = 0; i < flags.size(); ++i) {
+							if ((mask >> i) & 1)
+								c.flags.push_back(flags[i]);
+						}
+
+						cases.push_back(c);
+					}
+				}
+			}
+		}
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	char usage_report[] = "/tmp/sha1-sat-bench.XXXXXX";
+	int fd = mkstemp(usage_report);
+	if (fd == -1) {
+		std::cerr << "could not create temporary file\n";
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+
+	std::vector<bench_result> results;
+	try {
+		for (const bench_case &c: cases) {
+			bench_result best = run(generator, c, seed, usage_report);
+			for (unsigned int i = 1; i < nr_repeats; ++i) {
+				bench_result r = run(generator, c, seed, usage_report);
+				if (r.seconds < best.seconds)
+					best = r;
+			}
+
+			std::cerr << format("$: $ s\n", c.name(), best.seconds);
+			results.push_back(best);
+		}
+	} catch (const std::exception &e) {
+		unlink(usage_report);
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	unlink(usage_report);
+
+	std::ostringstream out;
+	out << "{\n";
+	out << format("\t\"generator\": \"$\",\n", generator);
+	out << format("\t\"seed\": $,\n", seed);
+	out << format("\t\"repeat\": $,\n", nr_repeats);
+	out << "\t\"results\": [\n";
+
+	for (unsigned int i = 0; i < cases.size(); ++i) {
+		const bench_case &c = cases[i];
+		const bench_result &r = results[i];
+
+		out << format("\t\t{\"name\": \"$\", \"seconds\": $, \"instances_per_second\": $, \"bytes\": $, \"bytes_per_second\": $, \"allocations\": $, \"max_rss_kb\": $}$\n",
+			c.name(), r.seconds, 1 / r.seconds, r.bytes, r.bytes / r.seconds,
+			r.allocations, r.max_rss_kb, i + 1 < cases.size() ? "," : "");
+	}
+
+	out << "\t]\n";
+	out << "}\n";
+
+	if (output.empty()) {
+		std::cout << out.str();
+	} else {
+		std::ofstream f(output.c_str());
+		f << out.str();
+		if (!f) {
+			std::cerr << format("$: could not write results\n", output);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (baseline.empty())
+		return 0;
+
+	std::map<std::string, bench_result> old;
+	try {
+		old = read_baseline(baseline);
+	} catch (const std::exception &e) {
+		std::cerr << format("$: $\n", baseline, e.what());
+		return EXIT_FAILURE;
+	}
+
+	/* Time is noisy, so all three are only compared with some slack.
+	 * Cases that take a few milliseconds are mostly process startup and
+	 * their times are not compared at all. */
+	unsigned int nr_regressions = 0;
+	for (unsigned int i = 0; i < cases.size(); ++i) {
+		auto it = old.find(cases[i].name());
+		if (it == old.end())
+			continue;
+
+		const bench_result &a = it->second;
+		const bench_result &b = results[i];
+
+		if (a.seconds >= MIN_COMPARED_SECONDS && b.seconds > a.seconds * (1 + tolerance)) {
+			std::cerr << format("regression: $: $ s -> $ s\n", cases[i].name(), a.seconds, b.seconds);
+			++nr_regressions;
+		}
+
+		if (b.allocations > a.allocations * (1 + tolerance)) {
+			std::cerr << format("regression: $: $ -> $ allocations\n", cases[i].name(), a.allocations, b.allocations);
+			++nr_regressions;
+		}
+
+		if (b.max_rss_kb > a.max_rss_kb * (1 + tolerance)) {
+			std::cerr << format("regression: $: $ -> $ kB peak RSS\n", cases[i].name(), a.max_rss_kb, b.max_rss_kb);
+			++nr_regressions;
+		}
+	}
+
+	std::cerr << format("$ regressions against $\n", nr_regressions, baseline);
+	return nr_regressions ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Exhaustive search baseline for (second) preimage instances.
+ *
+ * The fixed message and hash bits are read from the symbol map written
+ * with --map. The free message bits are enumerated on all cores, with
+ * SHA1_LANES messages per call to the multi-buffer kernel: the lowest
+ * free bits select the lane and the remaining ones are walked in Gray
+ * code order, so that only one message bit changes between calls.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "format.hh"
+#include "sha1.hh"
+#include "solution.hh"
+
+/* Number of kernel calls a thread does before taking more work */
+#define CHUNK_SIZE (1UL << 12)
+
+struct search_space {
+	unsigned int nr_rounds;
+
+	/* Message with all free bits cleared */
+	uint32_t base[16];
+
+	/* (word, bit) of each free message bit */
+	std::vector<std::pair<unsigned int, unsigned int>> free_bits;
+
+	uint32_t hash_mask[5];
+	uint32_t hash_value[5];
+};
+
+struct search_state {
+	std::atomic<uint64_t> next_chunk;
+	std::atomic<uint64_t> nr_keys;
+	std::atomic<bool> stop;
+
+	std::mutex lock;
+	bool found;
+	uint32_t message[16];
+	double time_to_solution;
+
+	std::chrono::steady_clock::time_point start;
+	double time_limit;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Parse "w[<n>]" or "h_out<n>" */
+static bool parse_word(const std::string &name, const char *prefix, const char *suffix, unsigned int &x)
+{
+	size_t n = strlen(prefix);
+	if (name.compare(0, n, prefix) != 0)
+		return false;
+
+	char *end;
+	x = strtoul(name.c_str() + n, &end, 10);
+	return end != name.c_str() + n && !strcmp(end, suffix);
+}
+
+static void load_search_space(const symbol_table &symbols, search_space &s)
+{
+	if (symbols.attack == "collision")
+		throw std::runtime_error("collision instances cannot be brute-forced this way");
+	if (!symbols.have_constraints)
+		throw std::runtime_error("the symbol map does not record the fixed bits");
+
+	s.nr_rounds = symbols.nr_rounds;
+
+	uint32_t message_mask[16] = {};
+	memset(s.base, 0, sizeof(s.base));
+	memset(s.hash_mask, 0, sizeof(s.hash_mask));
+	memset(s.hash_value, 0, sizeof(s.hash_value));
+
+	for (const map_constraint &c: symbols.constraints) {
+		unsigned int r;
+
+		if (c.type != CONSTRAINT_FIXED)
+			throw std::runtime_error("only fixed message and hash bits are supported");
+
+		if (parse_word(c.name, "w[", "]", r) && r < 16) {
+			message_mask[r] |= 1U << c.bit;
+			s.base[r] |= uint32_t(c.value) << c.bit;
+		} else if (parse_word(c.name, "h_out", "", r) && r < 5) {
+			s.hash_mask[r] |= 1U << c.bit;
+			s.hash_value[r] |= uint32_t(c.value) << c.bit;
+		} else {
+			throw std::runtime_error(format("unexpected constraint on $", c.name));
+		}
+	}
+
+	for (unsigned int i = 0; i < 16; ++i) {
+		for (unsigned int j = 0; j < 32; ++j) {
+			if (!((message_mask[i] >> j) & 1))
+				s.free_bits.push_back(std::make_pair(i, j));
+		}
+	}
+}
+
+static void search(const search_space &s, search_state &state)
+{
+	/* Free bits used to tell the lanes apart */
+	unsigned int nr_lane_bits = 0;
+	while ((1U << nr_lane_bits) < SHA1_LANES && nr_lane_bits < s.free_bits.size())
+		++nr_lane_bits;
+
+	unsigned int nr_high_bits = s.free_bits.size() - nr_lane_bits;
+	uint64_t nr_calls = uint64_t(1) << nr_high_bits;
+
+	sha1_lanes lanes;
+	uint32_t w[16];
+
+	while (!state.stop) {
+		uint64_t begin = state.next_chunk++ * CHUNK_SIZE;
+		if (begin >= nr_calls)
+			break;
+
+		uint64_t end = std::min(begin + CHUNK_SIZE, nr_calls);
+
+		/* The message for Gray code g(begin) = begin ^ (begin >> 1) */
+		uint64_t g = begin ^ (begin >> 1);
+		memcpy(w, s.base, sizeof(w));
+		for (unsigned int i = 0; i < nr_high_bits; ++i) {
+			if ((g >> i) & 1) {
+				const auto &bit = s.free_bits[nr_lane_bits + i];
+				w[bit.first] |= 1U << bit.second;
+			}
+		}
+
+		for (unsigned int lane = 0; lane < SHA1_LANES; ++lane) {
+			for (unsigned int i = 0; i < 16; ++i)
+				lanes.w[i][lane] = w[i];
+
+			for (unsigned int i = 0; i < nr_lane_bits; ++i) {
+				if ((lane >> i) & 1) {
+					const auto &bit = s.free_bits[i];
+					lanes.w[bit.first][lane] |= 1U << bit.second;
+				}
+			}
+		}
+
+		for (uint64_t call = begin; call < end; ++call) {
+			for (unsigned int i = 0; i < 5; ++i) {
+				for (unsigned int lane = 0; lane < SHA1_LANES; ++lane)
+					lanes.h[i][lane] = sha1_iv[i];
+			}
+
+			sha1_compress_lanes(s.nr_rounds, lanes);
+
+			for (unsigned int lane = 0; lane < SHA1_LANES; ++lane) {
+				bool match = true;
+				for (unsigned int i = 0; i < 5; ++i) {
+					if ((lanes.h[i][lane] & s.hash_mask[i]) != s.hash_value[i])
+						match = false;
+				}
+
+				if (!match)
+					continue;
+
+				std::lock_guard<std::mutex> guard(state.lock);
+				if (!state.found) {
+					state.found = true;
+					state.time_to_solution = seconds_since(state.start);
+					for (unsigned int i = 0; i < 16; ++i)
+						state.message[i] = lanes.w[i][lane];
+				}
+
+				state.stop = true;
+			}
+
+			/* Step to the next Gray code: flip one free bit in all lanes */
+			if (call + 1 < end) {
+				const auto &bit = s.free_bits[nr_lane_bits + __builtin_ctzll(call + 1)];
+				for (unsigned int lane = 0; lane < SHA1_LANES; ++lane)
+					lanes.w[bit.first][lane] ^= 1U << bit.second;
+			}
+		}
+
+		state.nr_keys += (end - begin) << nr_lane_bits;
+
+		if (state.time_limit > 0 && seconds_since(state.start) > state.time_limit)
+			state.stop = true;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::string map_filename;
+	unsigned int nr_threads = std::thread::hardware_concurrency();
+	double time_limit = 0;
+
+	{
+		using namespace boost::program_options;
+
+		options_description options("Options");
+		options.add_options()
+			("help,h", "Display this information")
+			("map", value<std::string>(&map_filename), "Symbol map of the instance (written by main --map)")
+			("threads", value<unsigned int>(&nr_threads), "Number of worker threads")
+			("time-limit", value<double>(&time_limit), "Give up after this many seconds")
+		;
+
+		positional_options_description p;
+		p.add("map", 1);
+
+		variables_map map;
+		store(command_line_parser(argc, argv)
+			.options(options)
+			.positional(p)
+			.run(), map);
+		notify(map);
+
+		if (map.count("help") || map_filename.empty()) {
+			std::cout << format("Usage: $ [OPTIONS] MAP\n", argv[0]) << options;
+			return map.count("help") ? 0 : EXIT_FAILURE;
+		}
+	}
+
+	if (!nr_threads)
+		nr_threads = 1;
+
+	search_space s;
+	try {
+		symbol_table symbols;
+		symbols.load(map_filename);
+		load_search_space(symbols, s);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	if (s.free_bits.size() > 60) {
+		std::cerr << format("$ free message bits is too many to enumerate\n", s.free_bits.size());
+		return EXIT_FAILURE;
+	}
+
+	search_state state;
+	state.next_chunk = 0;
+	state.nr_keys = 0;
+	state.stop = false;
+	state.found = false;
+	state.time_to_solution = 0;
+	state.time_limit = time_limit;
+	state.start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < nr_threads; ++i)
+		threads.push_back(std::thread(search, std::cref(s), std::ref(state)));
+	for (std::thread &t: threads)
+		t.join();
+
+	double seconds = seconds_since(state.start);
+	uint64_t nr_keys = state.nr_keys;
+
+	std::cout << "{\n";
+	std::cout << format("\t\"nr_rounds\": $,\n", s.nr_rounds);
+	std::cout << format("\t\"free_bits\": $,\n", s.free_bits.size());
+	std::cout << format("\t\"threads\": $,\n", nr_threads);
+	std::cout << format("\t\"kernel\": \"$\",\n", sha1_kernel_names[sha1_lanes_kernel()]);
+	std::cout << format("\t\"keys\": $,\n", nr_keys);
+	std::cout << format("\t\"seconds\": $,\n", seconds);
+	std::cout << format("\t\"keys_per_second\": $,\n", seconds > 0 ? nr_keys / seconds : 0);
+	std::cout << format("\t\"found\": $", state.found ? "true" : "false");
+
+	if (state.found) {
+		std::cout << format(",\n\t\"time_to_solution\": $,\n", state.time_to_solution);
+		std::cout << "\t\"message\": [";
+		for (unsigned int i = 0; i < 16; ++i) {
+			char buf[16];
+			snprintf(buf, sizeof(buf), "\"%08x\"", state.message[i]);
+			std::cout << (i ? ", " : "") << buf;
+		}
+		std::cout << "]";
+	}
+
+	std::cout << "\n}\n";
+
+	return state.found ? 0 : 1;
+}
@@ -0,0 +1,426 @@
+#ifndef CACHE_HH
+#define CACHE_HH
+
+/*
+ * On-disk cache of generated instances, used with --cache.
+ *
+ * An entry is keyed by the SHA-1 of the normalised options that
+ * determine the instance (attack, rounds, fixed bits, seed, format and
+ * encoding flags) together with the SHA-1 of the generator itself and of
+ * the half-adder tables, so that a rebuilt generator never serves stale
+ * instances. Each entry is two files in the cache directory:
+ *
+ *     <key>.inst (or <key>.inst.gz)   the instance as it was printed
+ *     <key>.map                       its symbol map (see --map)
+ *
+ * Entries are written to temporary files in the same directory and
+ * renamed into place, the map first, so that concurrent generators and
+ * readers only ever see complete entries; two writers racing for the same
+ * key produce identical files and the last rename wins. A reader opens
+ * both files before copying anything, so an entry that is evicted while
+ * it is being served is still served in full.
+ *
+ * Uncompressed entries are copied to standard output by the kernel
+ * (copy_file_range(), or sendfile() into pipes and sockets). Compressed
+ * entries take about a tenth of the space but have to be inflated.
+ *
+ * Eviction is least recently used: a hit touches the modification time
+ * of the instance, and after an insert the oldest entries are removed
+ * until the cache fits in its budget.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+}
+
+#include "format.hh"
+#include "sha1.hh"
+
+/* Temporary files left behind by a generator that died are removed
+ * once they are this old */
+#define CACHE_STALE_SECONDS (24 * 60 * 60)
+
+static inline void cache_write_all(int fd, const char *p, size_t n)
+{
+	while (n) {
+		ssize_t len = write(fd, p, n);
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			throw std::runtime_error("write() failed");
+
+		p += len;
+		n -= len;
+	}
+}
+
+/* Copy the rest of in to out. copy_file_range() only works between
+ * regular files; sendfile() also works into pipes and sockets. Both
+ * advance the file offsets, so each fallback continues where the
+ * previous one stopped. */
+static inline void cache_copy(int in, int out)
+{
+	while (true) {
+		ssize_t len = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+		if (len > 0)
+			continue;
+		if (len == 0)
+			return;
+		if (errno == EINTR)
+			continue;
+		break;
+	}
+
+	while (true) {
+		ssize_t len = sendfile(out, in, NULL, 1 << 30);
+		if (len > 0)
+			continue;
+		if (len == 0)
+			return;
+		if (errno == EINTR)
+			continue;
+		break;
+	}
+
+	static char buf[1 << 16];
+	while (true) {
+		ssize_t len = read(in, buf, sizeof(buf));
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len == -1)
+			throw std::runtime_error("read() failed");
+		if (len == 0)
+			return;
+
+		cache_write_all(out, buf, len);
+	}
+}
+
+static inline void cache_inflate(int in, int out)
+{
+	gzFile f = gzdopen(dup(in), "rb");
+	if (!f)
+		throw std::runtime_error("gzdopen() failed");
+
+	static char buf[1 << 16];
+	while (true) {
+		int len = gzread(f, buf, sizeof(buf));
+		if (len < 0) {
+			gzclose(f);
+			throw std::runtime_error("corrupt cache entry");
+		}
+		if (len == 0)
+			break;
+
+		cache_write_all(out, buf, len);
+	}
+
+	gzclose(f);
+}
+
+static inline void cache_digest_file(sha1_digest &d, const std::string &filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1)
+		return;
+
+	static char buf[1 << 16];
+	while (true) {
+		ssize_t len = read(fd, buf, sizeof(buf));
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		d.update(buf, len);
+	}
+
+	close(fd);
+}
+
+/* Everything besides the options that the output depends on */
+static inline std::string cache_generator_version()
+{
+	sha1_digest d;
+	cache_digest_file(d, "/proc/self/exe");
+
+	std::vector<std::string> tables;
+	if (DIR *dir = opendir("data")) {
+		while (struct dirent *e = readdir(dir)) {
+			std::string name = e->d_name;
+			if (name.size() > 8 && name.compare(name.size() - 8, 8, ".out.txt") == 0)
+				tables.push_back(name);
+		}
+
+		closedir(dir);
+	}
+
+	std::sort(tables.begin(), tables.end());
+	for (const std::string &name: tables) {
+		d.update(name.c_str(), name.size() + 1);
+		cache_digest_file(d, "data/" + name);
+	}
+
+	return d.hex();
+}
+
+class instance_cache {
+public:
+	instance_cache(const std::string &dir, unsigned long max_bytes, bool compress, const std::string &options):
+		dir(dir),
+		max_bytes(max_bytes),
+		compress(compress)
+	{
+		if (mkdir(dir.c_str(), 0777) == -1 && errno != EEXIST)
+			throw std::runtime_error(format("$: could not create cache directory", dir));
+
+		std::string s = format("$\nversion=$\n", options, cache_generator_version());
+
+		sha1_digest d;
+		d.update(s.data(), s.size());
+		key = d.hex();
+	}
+
+	~instance_cache()
+	{
+		if (!map_temporary.empty())
+			unlink(map_temporary.c_str());
+	}
+
+	/* Copy a cached instance to standard output and its map to
+	 * map_filename (if not empty); returns false on a miss */
+	bool serve(const std::string &map_filename)
+	{
+		bool compressed = false;
+		int in = open(path(".inst").c_str(), O_RDONLY);
+		if (in == -1) {
+			compressed = true;
+			in = open(path(".inst.gz").c_str(), O_RDONLY);
+		}
+		if (in == -1)
+			return false;
+
+		int map_in = open(path(".map").c_str(), O_RDONLY);
+		if (map_in == -1) {
+			close(in);
+			return false;
+		}
+
+		/* Recently used */
+		futimens(in, NULL);
+
+		if (!map_filename.empty()) {
+			int map_out = open(map_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+			if (map_out == -1)
+				throw std::runtime_error("could not open symbol map");
+
+			cache_copy(map_in, map_out);
+			close(map_out);
+		}
+
+		close(map_in);
+
+		if (compressed)
+			cache_inflate(in, STDOUT_FILENO);
+		else
+			cache_copy(in, STDOUT_FILENO);
+
+		close(in);
+		return true;
+	}
+
+	/* Where to write the map of an instance that is going to be
+	 * inserted, if it is not wanted anywhere else */
+	const std::string &map_temporary_file()
+	{
+		if (map_temporary.empty())
+			close(temporary(map_temporary));
+
+		return map_temporary;
+	}
+
+	/* Add the instance (the concatenation of the pieces) and the map in
+	 * map_filename, then evict down to the budget */
+	void insert(const std::string &map_filename, const std::vector<std::string> &pieces)
+	{
+		std::string map_tmp;
+		if (map_filename == map_temporary) {
+			map_tmp = map_temporary;
+			map_temporary.clear();
+		} else {
+			int out = temporary(map_tmp);
+			int in = open(map_filename.c_str(), O_RDONLY);
+			if (in == -1) {
+				close(out);
+				unlink(map_tmp.c_str());
+				throw std::runtime_error("could not open symbol map");
+			}
+
+			cache_copy(in, out);
+			close(in);
+			close(out);
+		}
+
+		std::string inst_tmp;
+		int out = temporary(inst_tmp);
+		if (compress) {
+			gzFile f = gzdopen(out, "wb");
+			if (!f)
+				throw std::runtime_error("gzdopen() failed");
+
+			for (const std::string &s: pieces) {
+				for (size_t i = 0; i < s.size(); i += 1 << 30) {
+					unsigned int len = std::min(s.size() - i, (size_t) 1 << 30);
+					if (gzwrite(f, s.data() + i, len) != (int) len)
+						throw std::runtime_error("gzwrite() failed");
+				}
+			}
+
+			if (gzclose(f) != Z_OK)
+				throw std::runtime_error("gzclose() failed");
+		} else {
+			for (const std::string &s: pieces)
+				cache_write_all(out, s.data(), s.size());
+
+			close(out);
+		}
+
+		if (rename(map_tmp.c_str(), path(".map").c_str()) == -1)
+			throw std::runtime_error("rename() failed");
+
+		/* Only one of the two forms is ever looked at */
+		unlink(path(compress ? ".inst" : ".inst.gz").c_str());
+		if (rename(inst_tmp.c_str(), path(compress ? ".inst.gz" : ".inst").c_str()) == -1)
+			throw std::runtime_error("rename() failed");
+
+		evict();
+	}
+
+private:
+	std::string dir;
+	unsigned long max_bytes;
+	bool compress;
+	std::string key;
+	std::string map_temporary;
+
+	std::string path(const char *suffix) const
+	{
+		return format("$/$$", dir, key, suffix);
+	}
+
+	int temporary(std::string &filename)
+	{
+		std::string name = format("$/.tmp-XXXXXX", dir);
+		std::vector<char> buf(name.begin(), name.end());
+		buf.push_back('\0');
+
+		int fd = mkstemp(&buf[0]);
+		if (fd == -1)
+			throw std::runtime_error(format("$: could not create temporary file", dir));
+
+		/* mkstemp() creates files that only we can read */
+		fchmod(fd, 0644);
+
+		filename = &buf[0];
+		return fd;
+	}
+
+	bool exists(const std::string &filename) const
+	{
+		return access(filename.c_str(), F_OK) == 0;
+	}
+
+	/* Remove the least recently used entries until the cache fits */
+	void evict()
+	{
+		struct entry {
+			std::string name;
+			struct timespec mtime;
+			unsigned long size;
+		};
+
+		std::vector<entry> entries;
+		unsigned long total = 0;
+
+		DIR *d = opendir(dir.c_str());
+		if (!d)
+			return;
+
+		while (struct dirent *e = readdir(d)) {
+			std::string name = e->d_name;
+			std::string filename = format("$/$", dir, name);
+
+			struct stat st;
+			if (stat(filename.c_str(), &st) == -1 || !S_ISREG(st.st_mode))
+				continue;
+
+			bool stale = time(0) - st.st_mtime > CACHE_STALE_SECONDS;
+			if (name.compare(0, 5, ".tmp-") == 0) {
+				if (stale)
+					unlink(filename.c_str());
+				continue;
+			}
+
+			size_t dot = name.find('.');
+			if (dot == std::string::npos)
+				continue;
+
+			std::string base = format("$/$", dir, name.substr(0, dot));
+			std::string suffix = name.substr(dot);
+
+			/* A map whose instance never arrived (or was evicted
+			 * while the map was being replaced) */
+			if (suffix == ".map" && stale && !exists(base + ".inst") && !exists(base + ".inst.gz")) {
+				unlink(filename.c_str());
+				continue;
+			}
+
+			total += st.st_size;
+
+			/* The map's size is charged to the instance */
+			if (suffix != ".inst" && suffix != ".inst.gz")
+				continue;
+
+			unsigned long size = st.st_size;
+			struct stat map_st;
+			if (stat((base + ".map").c_str(), &map_st) == 0)
+				size += map_st.st_size;
+
+			entries.push_back(entry{name, st.st_mtim, size});
+		}
+
+		closedir(d);
+
+		std::sort(entries.begin(), entries.end(), [](const entry &a, const entry &b) {
+			return a.mtime.tv_sec < b.mtime.tv_sec
+				|| (a.mtime.tv_sec == b.mtime.tv_sec && a.mtime.tv_nsec < b.mtime.tv_nsec);
+		});
+
+		for (const entry &e: entries) {
+			if (total <= max_bytes)
+				break;
+
+			/* The instance first, so that readers never find an
+			 * instance without its map */
+			unlink(format("$/$", dir, e.name).c_str());
+			unlink(format("$/$.map", dir, e.name.substr(0, e.name.find('.'))).c_str());
+			total -= std::min(total, e.size);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,796 @@
+#ifndef CIRCUIT_HH
+#define CIRCUIT_HH
+
+/*
+ * Gate-level description of an instance, with bit-parallel simulation.
+ *
+ * The encoding functions in main.cc record how every variable they define
+ * is computed from their inputs. Values are bit-sliced: a variable holds a
+ * uint64_t whose bits are its values under 64 different messages, so one
+ * evaluation of a gate simulates it on 64 messages at once. Gates are
+ * recorded in the order they are defined, which is a topological order,
+ * and are evaluated as soon as they are defined.
+ *
+ * mine() runs the circuit on many random messages and collects variables
+ * that were never seen to differ from a constant, from another variable
+ * (or its negation), or to violate a binary clause with a variable
+ * computed from the same inputs. Such a candidate is only reported if it
+ * can be proven: the gates between its variables and a small cut are
+ * evaluated for every assignment of the cut. The cut variables are
+ * treated as independent, which can make a true relation fail the check
+ * but never lets a false one pass. The cut starts at the variables
+ * themselves and is moved towards the inputs one gate at a time.
+ *
+ * With simplification enabled, every gate is also rewritten as it is
+ * defined: inputs are replaced by what they are known to equal, constants
+ * are folded, duplicate and complementary inputs are removed (x ^ x = 0,
+ * x & ~x = 0, maj(x, ~x, y) = y, ...) and the result is looked up in a
+ * table of the gates defined so far (structural hashing). If that shows
+ * that the output is a constant or equals an earlier literal, the gate
+ * does not need to be encoded: replacement() says what to encode instead.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "format.hh"
+
+/* Limits for proving a candidate: the number of cut variables (every
+ * assignment is tried) and the number of gates pulled into the cut */
+#define CIRCUIT_PROOF_LEAVES 12
+#define CIRCUIT_PROOF_STEPS 16
+
+/* Binary clauses are only looked for between the outputs of gates that
+ * read the same few variables */
+#define CIRCUIT_MAX_GROUP_INPUTS 8
+#define CIRCUIT_MAX_GROUP_OUTPUTS 8
+
+/* The literal true in replacement() (and -CIRCUIT_TRUE for false) */
+#define CIRCUIT_TRUE INT_MAX
+
+enum gate_type {
+	/* A message bit */
+	GATE_INPUT,
+	GATE_CONSTANT,
+	GATE_XOR,
+	GATE_AND,
+	GATE_OR,
+	/* Inputs b, c, d; (b & c) | (~b & d) and the majority of the three */
+	GATE_CH,
+	GATE_MAJ,
+	/* Output i is bit i of the sum of the inputs, where input j counts
+	 * 2^shifts[j] */
+	GATE_SUM,
+};
+
+struct gate {
+	gate_type type;
+	std::vector<int> outputs;
+
+	/* Literals */
+	std::vector<int> inputs;
+	std::vector<uint8_t> shifts;
+
+	/* GATE_CONSTANT */
+	bool value;
+};
+
+/* Lemmas found by circuit::mine() */
+struct circuit_lemmas {
+	std::vector<int> units;
+
+	/* The variable equals the literal */
+	std::vector<std::pair<int, int>> equivalences;
+
+	/* Binary clauses */
+	std::vector<std::pair<int, int>> implications;
+
+	unsigned long nr_candidates;
+};
+
+class circuit {
+public:
+	circuit():
+		simplifying(false),
+		definition(1, -1),
+		values(1, 0),
+		replacements(1, 0)
+	{
+	}
+
+	void resize(unsigned int nr_variables)
+	{
+		definition.resize(nr_variables + 1, -1);
+		values.resize(nr_variables + 1, 0);
+		replacements.resize(nr_variables + 1, 0);
+	}
+
+	void enable_simplification()
+	{
+		simplifying = true;
+	}
+
+	/* The literal (or +-CIRCUIT_TRUE) that the gate defining x was
+	 * simplified to, or 0 if the gate has to be encoded */
+	int replacement(int x) const
+	{
+		int r = replacements[abs(x)];
+		return x < 0 ? -r : r;
+	}
+
+	bool defined(int x) const
+	{
+		return definition[abs(x)] >= 0;
+	}
+
+	uint64_t value(int x) const
+	{
+		if (!defined(x))
+			throw std::runtime_error(format("circuit: variable $ is used before it is defined", abs(x)));
+
+		return literal(values, x);
+	}
+
+	const std::vector<gate> &gate_list() const
+	{
+		return gates;
+	}
+
+	/* The position of the gate defining x in the order the gates were
+	 * defined (a topological order) */
+	int gate_number(int x) const
+	{
+		return definition[abs(x)];
+	}
+
+	/* A fresh random value for the lanes that are not given */
+	uint64_t random_value()
+	{
+		return random();
+	}
+
+	void define_input(int x, uint64_t value)
+	{
+		if (defined(x))
+			return;
+
+		gate g = gate();
+		g.type = GATE_INPUT;
+		g.outputs.push_back(abs(x));
+		add(g);
+
+		values[abs(x)] = x < 0 ? ~value : value;
+	}
+
+	void define_constant(int x, bool value)
+	{
+		gate g = gate();
+		g.type = GATE_CONSTANT;
+		g.outputs.push_back(abs(x));
+		g.value = (x < 0) ^ value;
+		define(g);
+	}
+
+	void define(gate_type type, int r, const std::vector<int> &inputs)
+	{
+		gate g = gate();
+		g.type = type;
+		g.outputs.push_back(r);
+		g.inputs = inputs;
+		define(g);
+	}
+
+	void define_sum(const std::vector<int> &outputs, const std::vector<int> &inputs, const std::vector<uint8_t> &shifts)
+	{
+		gate g = gate();
+		g.type = GATE_SUM;
+		g.outputs = outputs;
+
+		/* Lowest weights first, so that they can be added in one pass */
+		std::vector<unsigned int> order(inputs.size());
+		for (unsigned int i = 0; i < order.size(); ++i)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int i, unsigned int j) {
+			return shifts[i] < shifts[j];
+		});
+
+		for (unsigned int i: order) {
+			g.inputs.push_back(inputs[i]);
+			g.shifts.push_back(shifts[i]);
+		}
+
+		define(g);
+	}
+
+	/* A gate whose outputs are already defined is a constraint (e.g. a
+	 * fixed hash bit), not a definition, and is not recorded */
+	void define(const gate &g)
+	{
+		for (int x: g.outputs) {
+			if (defined(x))
+				return;
+		}
+
+		for (int x: g.inputs) {
+			if (!defined(x))
+				throw std::runtime_error(format("circuit: variable $ is used before it is defined", abs(x)));
+		}
+
+		add(g);
+		evaluate(g, values);
+
+		if (simplifying)
+			simplify(g);
+	}
+
+	void mine(unsigned int nr_passes, circuit_lemmas &lemmas)
+	{
+		unsigned int n = values.size();
+
+		/* Candidate binary clauses: pairs of variables computed from
+		 * the same inputs */
+		std::map<std::vector<int>, std::vector<int>> groups;
+		for (const gate &g: gates) {
+			if (g.type == GATE_INPUT || g.type == GATE_CONSTANT || g.inputs.size() > CIRCUIT_MAX_GROUP_INPUTS)
+				continue;
+
+			std::vector<int> key;
+			for (int x: g.inputs)
+				key.push_back(abs(x));
+			std::sort(key.begin(), key.end());
+			key.erase(std::unique(key.begin(), key.end()), key.end());
+
+			std::vector<int> &group = groups[key];
+			group.insert(group.end(), g.outputs.begin(), g.outputs.end());
+		}
+
+		struct pair_candidate {
+			int x;
+			int y;
+			/* Lanes where (+-x | +-y) was false, by sign */
+			uint64_t falsified[4];
+		};
+
+		std::vector<pair_candidate> pairs;
+		for (const auto &it: groups) {
+			const std::vector<int> &group = it.second;
+			if (group.size() > CIRCUIT_MAX_GROUP_OUTPUTS)
+				continue;
+
+			for (unsigned int i = 0; i < group.size(); ++i) {
+				for (unsigned int j = i + 1; j < group.size(); ++j)
+					pairs.push_back(pair_candidate{group[i], group[j], {0, 0, 0, 0}});
+			}
+		}
+
+		std::vector<uint64_t> saved = values;
+		std::vector<uint64_t> all_and(n, ~0UL);
+		std::vector<uint64_t> all_or(n, 0);
+		std::vector<uint64_t> signature(n, 0);
+		std::vector<bool> phase(n);
+
+		for (unsigned int pass = 0; pass < nr_passes; ++pass) {
+			simulate();
+
+			for (unsigned int x = 1; x < n; ++x) {
+				uint64_t v = values[x];
+				if (pass == 0)
+					phase[x] = v & 1;
+
+				all_and[x] &= v;
+				all_or[x] |= v;
+				signature[x] = mix(signature[x] ^ (phase[x] ? ~v : v));
+			}
+
+			for (pair_candidate &p: pairs) {
+				uint64_t x = values[p.x];
+				uint64_t y = values[p.y];
+
+				p.falsified[0] |= ~x & ~y;
+				p.falsified[1] |= x & ~y;
+				p.falsified[2] |= ~x & y;
+				p.falsified[3] |= x & y;
+			}
+		}
+
+		values = saved;
+
+		/* The variables with each signature that are not known to
+		 * equal an earlier one; a new variable is compared with each
+		 * of them until a proof succeeds */
+		std::vector<bool> constant(n);
+		std::unordered_map<uint64_t, std::vector<int>> classes;
+		std::vector<int> representative(n);
+
+		for (int x = 1; x < (int) n; ++x) {
+			representative[x] = x;
+
+			if (definition[x] < 0)
+				continue;
+
+			/* Already encoded as a constant or an equivalence */
+			gate_type type = gates[definition[x]].type;
+			if (type == GATE_INPUT || type == GATE_CONSTANT || replacements[x])
+				continue;
+
+			if (all_or[x] == 0 || all_and[x] == ~0UL) {
+				constant[x] = true;
+
+				int lit = all_or[x] ? x : -x;
+				++lemmas.nr_candidates;
+				if (prove({x}, [lit](const std::vector<uint64_t> &v) {
+					return ~literal(v, lit);
+				}))
+					lemmas.units.push_back(lit);
+
+				continue;
+			}
+
+			std::vector<int> &members = classes[signature[x]];
+			bool proven = false;
+			for (int y: members) {
+				int lit = phase[x] == phase[y] ? y : -y;
+
+				++lemmas.nr_candidates;
+				if (prove({x, y}, [x, lit](const std::vector<uint64_t> &v) {
+					return v[x] ^ literal(v, lit);
+				})) {
+					lemmas.equivalences.push_back(std::make_pair(x, lit));
+					representative[x] = representative[y];
+					proven = true;
+					break;
+				}
+			}
+
+			if (!proven)
+				members.push_back(x);
+		}
+
+		for (const pair_candidate &p: pairs) {
+			if (constant[p.x] || constant[p.y] || replacements[p.x] || replacements[p.y]
+				|| representative[p.x] == representative[p.y])
+				continue;
+
+			for (unsigned int i = 0; i < 4; ++i) {
+				if (p.falsified[i])
+					continue;
+
+				int x = i & 1 ? -p.x : p.x;
+				int y = i & 2 ? -p.y : p.y;
+
+				++lemmas.nr_candidates;
+				if (prove({p.x, p.y}, [x, y](const std::vector<uint64_t> &v) {
+					return ~literal(v, x) & ~literal(v, y);
+				}))
+					lemmas.implications.push_back(std::make_pair(x, y));
+			}
+		}
+	}
+
+private:
+	bool simplifying;
+	std::vector<gate> gates;
+
+	/* Per variable: the index of the gate that defines it (-1 if it is
+	 * not defined yet) and its values under 64 messages */
+	std::vector<int> definition;
+	std::vector<uint64_t> values;
+
+	std::mt19937_64 random;
+	std::vector<uint64_t> scratch;
+
+	/* Per variable: see replacement() */
+	std::vector<int> replacements;
+
+	/* The simplified gates defined so far. The key is the gate type
+	 * followed by its simplified inputs; the value is the literal that
+	 * equals the gate (for GATE_SUM, the index of the gate). */
+	std::map<std::vector<int>, int> structure;
+
+	static uint64_t literal(const std::vector<uint64_t> &v, int x)
+	{
+		return x < 0 ? ~v[-x] : v[x];
+	}
+
+	static uint64_t mix(uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+		return x ^ (x >> 31);
+	}
+
+	/* x, with the variable replaced by what it is known to equal */
+	int canonical(int x) const
+	{
+		int r = replacement(x);
+		return r ? r : x;
+	}
+
+	static bool is_constant(int x)
+	{
+		return abs(x) == CIRCUIT_TRUE;
+	}
+
+	/* Literals sorted by variable */
+	static void sort_literals(std::vector<int> &v)
+	{
+		std::sort(v.begin(), v.end(), [](int x, int y) {
+			return abs(x) < abs(y) || (abs(x) == abs(y) && x < y);
+		});
+	}
+
+	/* The literal that equals the gate described by key, if there is
+	 * one already; otherwise r becomes that literal */
+	int lookup(const std::vector<int> &key, int r)
+	{
+		auto it = structure.find(key);
+		if (it != structure.end())
+			return it->second;
+
+		structure[key] = r;
+		return 0;
+	}
+
+	/* What the single output of a gate equals, or 0 */
+	int simplify_output(const gate &g, std::vector<int> &in)
+	{
+		int r = g.outputs[0];
+
+		switch (g.type) {
+		case GATE_INPUT:
+		case GATE_SUM:
+			break;
+		case GATE_CONSTANT:
+			return g.value ? CIRCUIT_TRUE : -CIRCUIT_TRUE;
+		case GATE_XOR: {
+			bool parity = false;
+			std::vector<int> vars;
+			for (int x: in) {
+				if (is_constant(x)) {
+					parity ^= x > 0;
+				} else {
+					parity ^= x < 0;
+					vars.push_back(abs(x));
+				}
+			}
+
+			std::sort(vars.begin(), vars.end());
+
+			/* x ^ x = 0 */
+			std::vector<int> key(1, GATE_XOR);
+			for (unsigned int i = 0; i < vars.size(); ++i) {
+				if (i + 1 < vars.size() && vars[i] == vars[i + 1])
+					++i;
+				else
+					key.push_back(vars[i]);
+			}
+
+			if (key.size() == 1)
+				return parity ? CIRCUIT_TRUE : -CIRCUIT_TRUE;
+			if (key.size() == 2)
+				return parity ? -key[1] : key[1];
+
+			int x = lookup(key, parity ? -r : r);
+			return x && parity ? -x : x;
+		}
+		case GATE_AND:
+		case GATE_OR: {
+			/* a | b = ~(~a & ~b) */
+			bool negate = g.type == GATE_OR;
+
+			std::vector<int> lits;
+			for (int x: in) {
+				if (negate)
+					x = -x;
+
+				if (x == -CIRCUIT_TRUE)
+					return negate ? CIRCUIT_TRUE : -CIRCUIT_TRUE;
+				if (x != CIRCUIT_TRUE)
+					lits.push_back(x);
+			}
+
+			sort_literals(lits);
+			lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+
+			/* x & ~x = 0 */
+			for (unsigned int i = 0; i + 1 < lits.size(); ++i) {
+				if (lits[i] == -lits[i + 1])
+					return negate ? CIRCUIT_TRUE : -CIRCUIT_TRUE;
+			}
+
+			if (lits.empty())
+				return negate ? -CIRCUIT_TRUE : CIRCUIT_TRUE;
+			if (lits.size() == 1)
+				return negate ? -lits[0] : lits[0];
+
+			std::vector<int> key(1, GATE_AND);
+			key.insert(key.end(), lits.begin(), lits.end());
+
+			int x = lookup(key, negate ? -r : r);
+			return x && negate ? -x : x;
+		}
+		case GATE_CH: {
+			int b = in[0];
+			int c = in[1];
+			int d = in[2];
+
+			if (is_constant(b))
+				return b > 0 ? c : d;
+			if (c == d)
+				return c;
+			if (is_constant(c) && is_constant(d))
+				return c > 0 ? b : -b;
+
+			return lookup({GATE_CH, b, c, d}, r);
+		}
+		case GATE_MAJ: {
+			std::vector<int> lits = in;
+			sort_literals(lits);
+
+			/* Constants sort last */
+			for (unsigned int i = 0; i < 2; ++i) {
+				if (lits[i] == lits[i + 1])
+					return lits[i];
+				if (lits[i] == -lits[i + 1])
+					return lits[2 - 2 * i];
+			}
+			if (lits[0] == lits[2])
+				return lits[0];
+			if (lits[0] == -lits[2])
+				return lits[1];
+
+			return lookup({GATE_MAJ, lits[0], lits[1], lits[2]}, r);
+		}
+		}
+
+		return 0;
+	}
+
+	void simplify(const gate &g)
+	{
+		std::vector<int> in;
+		for (int x: g.inputs)
+			in.push_back(canonical(x));
+
+		if (g.type != GATE_SUM) {
+			replacements[g.outputs[0]] = simplify_output(g, in);
+			return;
+		}
+
+		/* A sum of constants is a constant */
+		bool constant = true;
+		for (int x: in)
+			constant = constant && is_constant(x);
+
+		if (constant) {
+			uint64_t sum = 0;
+			for (unsigned int i = 0; i < in.size(); ++i)
+				sum += uint64_t(in[i] > 0) << g.shifts[i];
+
+			for (unsigned int i = 0; i < g.outputs.size(); ++i)
+				replacements[g.outputs[i]] = (sum >> i) & 1 ? CIRCUIT_TRUE : -CIRCUIT_TRUE;
+			return;
+		}
+
+		std::vector<std::pair<int, int>> terms;
+		for (unsigned int i = 0; i < in.size(); ++i)
+			terms.push_back(std::make_pair(g.shifts[i], in[i]));
+		std::sort(terms.begin(), terms.end());
+
+		std::vector<int> key(1, GATE_SUM);
+		key.push_back(g.outputs.size());
+		for (const auto &it: terms) {
+			key.push_back(it.first);
+			key.push_back(it.second);
+		}
+
+		/* Gate numbers are stored plus one, 0 means not found */
+		int x = lookup(key, definition[g.outputs[0]] + 1);
+		if (!x)
+			return;
+
+		const gate &h = gates[x - 1];
+		for (unsigned int i = 0; i < g.outputs.size(); ++i)
+			replacements[g.outputs[i]] = canonical(h.outputs[i]);
+	}
+
+	void add(const gate &g)
+	{
+		for (int x: g.outputs)
+			definition[abs(x)] = gates.size();
+
+		gates.push_back(g);
+	}
+
+	static void evaluate(const gate &g, std::vector<uint64_t> &v)
+	{
+		switch (g.type) {
+		case GATE_INPUT:
+			break;
+		case GATE_CONSTANT:
+			v[g.outputs[0]] = g.value ? ~0UL : 0;
+			break;
+		case GATE_XOR: {
+			uint64_t r = 0;
+			for (int x: g.inputs)
+				r ^= literal(v, x);
+			v[g.outputs[0]] = r;
+			break;
+		}
+		case GATE_AND: {
+			uint64_t r = ~0UL;
+			for (int x: g.inputs)
+				r &= literal(v, x);
+			v[g.outputs[0]] = r;
+			break;
+		}
+		case GATE_OR: {
+			uint64_t r = 0;
+			for (int x: g.inputs)
+				r |= literal(v, x);
+			v[g.outputs[0]] = r;
+			break;
+		}
+		case GATE_CH: {
+			uint64_t b = literal(v, g.inputs[0]);
+			uint64_t c = literal(v, g.inputs[1]);
+			uint64_t d = literal(v, g.inputs[2]);
+			v[g.outputs[0]] = (b & c) | (~b & d);
+			break;
+		}
+		case GATE_MAJ: {
+			uint64_t b = literal(v, g.inputs[0]);
+			uint64_t c = literal(v, g.inputs[1]);
+			uint64_t d = literal(v, g.inputs[2]);
+			v[g.outputs[0]] = (b & c) | (b & d) | (c & d);
+			break;
+		}
+		case GATE_SUM: {
+			/* A bit-sliced counter: bit k of the count is counter[k] */
+			uint64_t counter[8] = {};
+
+			unsigned int j = 0;
+			for (unsigned int i = 0; i < g.outputs.size(); ++i) {
+				for (; j < g.inputs.size() && g.shifts[j] == i; ++j) {
+					uint64_t carry = literal(v, g.inputs[j]);
+					for (unsigned int k = 0; k < 8 && carry; ++k) {
+						uint64_t t = counter[k] & carry;
+						counter[k] ^= carry;
+						carry = t;
+					}
+				}
+
+				v[g.outputs[i]] = counter[0];
+				for (unsigned int k = 0; k < 7; ++k)
+					counter[k] = counter[k + 1];
+				counter[7] = 0;
+			}
+			break;
+		}
+		}
+	}
+
+	/* Every input gets new random values */
+	void simulate()
+	{
+		for (const gate &g: gates) {
+			if (g.type == GATE_INPUT)
+				values[g.outputs[0]] = random();
+			else
+				evaluate(g, values);
+		}
+	}
+
+	template<typename F>
+	bool prove(const std::vector<int> &vars, F violated)
+	{
+		scratch.resize(values.size());
+
+		std::set<unsigned int> cone;
+		std::set<int> leaves(vars.begin(), vars.end());
+
+		auto expand = [&](unsigned int i) {
+			const gate &g = gates[i];
+			cone.insert(i);
+
+			for (int x: g.outputs)
+				leaves.erase(x);
+			for (int x: g.inputs) {
+				if (!cone.count(definition[abs(x)]))
+					leaves.insert(abs(x));
+			}
+		};
+
+		for (unsigned int step = 0; ; ++step) {
+			/* Constants cost nothing */
+			while (true) {
+				int constant = 0;
+				for (int x: leaves) {
+					if (gates[definition[x]].type == GATE_CONSTANT)
+						constant = x;
+				}
+				if (!constant)
+					break;
+
+				expand(definition[constant]);
+			}
+
+			if (leaves.size() <= CIRCUIT_PROOF_LEAVES && exhaust(cone, leaves, violated))
+				return true;
+			if (step == CIRCUIT_PROOF_STEPS)
+				return false;
+
+			/* Move the cut past the gate that adds the fewest new
+			 * variables to it */
+			int best = -1;
+			unsigned int best_cost = 0;
+			for (int x: leaves) {
+				const gate &g = gates[definition[x]];
+				if (g.type == GATE_INPUT)
+					continue;
+
+				std::set<int> added;
+				for (int y: g.inputs) {
+					if (!leaves.count(abs(y)) && !cone.count(definition[abs(y)]))
+						added.insert(abs(y));
+				}
+
+				if (best == -1 || added.size() < best_cost) {
+					best = definition[x];
+					best_cost = added.size();
+				}
+			}
+
+			if (best == -1)
+				return false;
+
+			expand(best);
+			if (leaves.size() > CIRCUIT_PROOF_LEAVES)
+				return false;
+		}
+	}
+
+	/* Whether violated() is 0 for every assignment of the leaves */
+	template<typename F>
+	bool exhaust(const std::set<unsigned int> &cone, const std::set<int> &leaves, F violated)
+	{
+		static const uint64_t patterns[6] = {
+			0xaaaaaaaaaaaaaaaaUL,
+			0xccccccccccccccccUL,
+			0xf0f0f0f0f0f0f0f0UL,
+			0xff00ff00ff00ff00UL,
+			0xffff0000ffff0000UL,
+			0xffffffff00000000UL,
+		};
+
+		unsigned int nr_leaves = leaves.size();
+		unsigned long nr_words = nr_leaves <= 6 ? 1 : 1UL << (nr_leaves - 6);
+
+		for (unsigned long w = 0; w < nr_words; ++w) {
+			unsigned int k = 0;
+			for (int x: leaves) {
+				scratch[x] = k < 6 ? patterns[k] : ((w >> (k - 6)) & 1 ? ~0UL : 0);
+				++k;
+			}
+
+			for (unsigned int i: cone)
+				evaluate(gates[i], scratch);
+
+			if (violated(scratch))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+#endif
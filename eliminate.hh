@@ -0,0 +1,438 @@
+#ifndef ELIMINATE_HH
+#define ELIMINATE_HH
+
+/*
+ * SatELite-style preprocessing of a set of clauses (--eliminate).
+ *
+ * Unit clauses are propagated, clauses that are subsumed by another
+ * clause are removed, and self-subsuming resolution removes a literal l
+ * from a clause D when some clause C has ~l and the rest of C is in D.
+ * A variable is eliminated by replacing the clauses that contain it with
+ * all their non-tautological resolvents on it, as long as that adds at
+ * most `growth` clauses. Protected variables are never eliminated.
+ *
+ * The clauses of an eliminated variable are kept, with the variable's
+ * literal first, so that a model of the result can be extended to a model
+ * of the original clauses: going through them backwards, a clause that is
+ * false makes its first literal true.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+/* Variables with more clauses than this are not eliminated, and no
+ * resolvent longer than this is added */
+#define ELIMINATE_MAX_OCCURRENCES 16
+#define ELIMINATE_MAX_RESOLVENT 24
+
+class eliminator {
+public:
+	unsigned long nr_eliminated;
+	unsigned long nr_subsumed;
+	unsigned long nr_strengthened;
+
+	/* The clauses were found to be unsatisfiable */
+	bool empty_clause;
+
+	eliminator(unsigned int nr_variables):
+		nr_eliminated(0),
+		nr_subsumed(0),
+		nr_strengthened(0),
+		empty_clause(false),
+		occurrences(2 * (nr_variables + 1)),
+		marks(2 * (nr_variables + 1), 0),
+		mark_stamp(0),
+		values(nr_variables + 1, 0),
+		is_protected(nr_variables + 1, false),
+		eliminated(nr_variables + 1, false)
+	{
+	}
+
+	void protect(int x)
+	{
+		is_protected[abs(x)] = true;
+	}
+
+	void add_clause(const int *v, unsigned int n)
+	{
+		std::vector<int> lits(v, v + n);
+		std::sort(lits.begin(), lits.end());
+		lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+
+		for (int x: lits) {
+			if (std::binary_search(lits.begin(), lits.end(), -x))
+				return;
+		}
+
+		add(lits);
+	}
+
+	void run(unsigned int growth)
+	{
+		propagate();
+
+		for (unsigned int i = 0; i < clauses.size(); ++i)
+			queue.push_back(i);
+		subsume_queue();
+
+		while (!empty_clause && eliminate_pass(growth))
+			subsume_queue();
+	}
+
+	/* The remaining clauses, units first */
+	template<typename F>
+	void for_each_clause(F f) const
+	{
+		if (empty_clause) {
+			f(std::vector<int>());
+			return;
+		}
+
+		for (int x: units)
+			f(std::vector<int>(1, x));
+
+		for (const clause &c: clauses) {
+			if (!c.removed)
+				f(c.lits);
+		}
+	}
+
+	/* values[x] is the value of variable x in a model of the remaining
+	 * clauses; the eliminated variables get values that make it a
+	 * model of the original clauses */
+	void extend(std::vector<bool> &model) const
+	{
+		for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+			bool satisfied = false;
+			for (int x: *it)
+				satisfied = satisfied || model[abs(x)] == (x > 0);
+
+			if (!satisfied)
+				model[abs((*it)[0])] = (*it)[0] > 0;
+		}
+	}
+
+	/* Whether x no longer occurs in the clauses; extend() gives it a
+	 * value */
+	bool removed(int x) const
+	{
+		return eliminated[abs(x)];
+	}
+
+	const std::vector<std::vector<int>> &elimination_stack() const
+	{
+		return stack;
+	}
+
+private:
+	struct clause {
+		std::vector<int> lits;
+		bool removed;
+
+		/* A bit for each variable, so that a clause can only subsume
+		 * (or strengthen) another if its bits are a subset */
+		uint64_t signature;
+	};
+
+	std::vector<clause> clauses;
+
+	/* Clauses that contain each literal; removed clauses are dropped
+	 * lazily */
+	std::vector<std::vector<unsigned int>> occurrences;
+
+	std::vector<unsigned int> marks;
+	unsigned int mark_stamp;
+
+	/* Top-level assignments: 1, -1 or 0 */
+	std::vector<int8_t> values;
+	std::vector<int> units;
+	std::vector<int> pending;
+
+	std::vector<bool> is_protected;
+	std::vector<bool> eliminated;
+	std::vector<std::vector<int>> stack;
+
+	/* Clauses to check for subsumption */
+	std::vector<unsigned int> queue;
+
+	static uint64_t signature(const std::vector<int> &lits)
+	{
+		uint64_t r = 0;
+		for (int x: lits)
+			r |= 1UL << (abs(x) % 64);
+		return r;
+	}
+
+	static unsigned int index(int x)
+	{
+		return 2 * abs(x) + (x < 0);
+	}
+
+	int value(int x) const
+	{
+		return x < 0 ? -values[-x] : values[x];
+	}
+
+	std::vector<unsigned int> &occurrences_of(int x)
+	{
+		std::vector<unsigned int> &v = occurrences[index(x)];
+		v.erase(std::remove_if(v.begin(), v.end(), [this](unsigned int i) {
+			return clauses[i].removed;
+		}), v.end());
+		return v;
+	}
+
+	void assign(int x)
+	{
+		if (value(x) > 0)
+			return;
+		if (value(x) < 0) {
+			empty_clause = true;
+			return;
+		}
+
+		values[abs(x)] = x < 0 ? -1 : 1;
+		units.push_back(x);
+		pending.push_back(x);
+	}
+
+	void add(const std::vector<int> &lits)
+	{
+		if (lits.empty()) {
+			empty_clause = true;
+			return;
+		}
+
+		if (lits.size() == 1) {
+			assign(lits[0]);
+			return;
+		}
+
+		unsigned int i = clauses.size();
+		clauses.push_back(clause{lits, false, signature(lits)});
+		for (int x: lits)
+			occurrences[index(x)].push_back(i);
+		queue.push_back(i);
+	}
+
+	void remove(unsigned int i)
+	{
+		clauses[i].removed = true;
+	}
+
+	/* Remove x from clause i */
+	void strengthen(unsigned int i, int x)
+	{
+		std::vector<int> &lits = clauses[i].lits;
+		lits.erase(std::find(lits.begin(), lits.end(), x));
+		clauses[i].signature = signature(lits);
+
+		std::vector<unsigned int> &occ = occurrences[index(x)];
+		occ.erase(std::find(occ.begin(), occ.end(), i));
+
+		if (lits.size() == 1) {
+			remove(i);
+			assign(lits[0]);
+		} else {
+			queue.push_back(i);
+		}
+	}
+
+	void propagate()
+	{
+		while (!pending.empty() && !empty_clause) {
+			int x = pending.back();
+			pending.pop_back();
+
+			for (unsigned int i: occurrences_of(x))
+				remove(i);
+
+			std::vector<unsigned int> occ = occurrences_of(-x);
+			for (unsigned int i: occ)
+				strengthen(i, -x);
+		}
+	}
+
+	/* Remove the clauses that clause i subsumes and strengthen the ones
+	 * it can resolve away a literal from */
+	void subsume(unsigned int i)
+	{
+		/* The variable with the fewest occurrences (counting removed
+		 * clauses that have not been dropped yet, which is cheaper) */
+		int best = 0;
+		unsigned long best_size = 0;
+		for (int x: clauses[i].lits) {
+			unsigned long size = occurrences[index(x)].size() + occurrences[index(-x)].size();
+			if (!best || size < best_size) {
+				best = x;
+				best_size = size;
+			}
+		}
+
+		std::vector<unsigned int> candidates = occurrences_of(best);
+		const std::vector<unsigned int> &other = occurrences_of(-best);
+		candidates.insert(candidates.end(), other.begin(), other.end());
+
+		for (unsigned int j: candidates) {
+			const clause &c = clauses[i];
+			const clause &d = clauses[j];
+			if (j == i || c.removed || d.removed || d.lits.size() < c.lits.size()
+				|| (c.signature & ~d.signature))
+				continue;
+
+			++mark_stamp;
+			for (int x: d.lits)
+				marks[index(x)] = mark_stamp;
+
+			int flipped = 0;
+			bool subset = true;
+			for (int x: c.lits) {
+				if (marks[index(x)] == mark_stamp)
+					continue;
+
+				if (!flipped && marks[index(-x)] == mark_stamp) {
+					flipped = x;
+					continue;
+				}
+
+				subset = false;
+				break;
+			}
+
+			if (!subset)
+				continue;
+
+			if (!flipped) {
+				remove(j);
+				++nr_subsumed;
+			} else {
+				strengthen(j, -flipped);
+				++nr_strengthened;
+			}
+		}
+	}
+
+	void subsume_queue()
+	{
+		while (!queue.empty() && !empty_clause) {
+			unsigned int i = queue.back();
+			queue.pop_back();
+
+			if (!clauses[i].removed)
+				subsume(i);
+
+			propagate();
+		}
+	}
+
+	/* The resolvent of two clauses on x, or false if it is a tautology */
+	bool resolve(const std::vector<int> &a, const std::vector<int> &b, int x, std::vector<int> &r)
+	{
+		++mark_stamp;
+		r.clear();
+
+		for (int y: a) {
+			if (y == x)
+				continue;
+
+			marks[index(y)] = mark_stamp;
+			r.push_back(y);
+		}
+
+		for (int y: b) {
+			if (y == -x || marks[index(y)] == mark_stamp)
+				continue;
+			if (marks[index(-y)] == mark_stamp)
+				return false;
+
+			r.push_back(y);
+		}
+
+		return true;
+	}
+
+	bool eliminate(int x, unsigned int growth)
+	{
+		std::vector<unsigned int> pos = occurrences_of(x);
+		std::vector<unsigned int> neg = occurrences_of(-x);
+		if (pos.size() + neg.size() > ELIMINATE_MAX_OCCURRENCES)
+			return false;
+
+		std::vector<std::vector<int>> resolvents;
+		std::vector<int> r;
+		for (unsigned int i: pos) {
+			for (unsigned int j: neg) {
+				if (!resolve(clauses[i].lits, clauses[j].lits, x, r))
+					continue;
+
+				if (r.size() > ELIMINATE_MAX_RESOLVENT
+					|| resolvents.size() == pos.size() + neg.size() + growth)
+					return false;
+
+				std::sort(r.begin(), r.end());
+				resolvents.push_back(r);
+			}
+		}
+
+		for (unsigned int i: pos) {
+			stack.push_back(pivot_first(clauses[i].lits, x));
+			remove(i);
+		}
+
+		for (unsigned int i: neg) {
+			stack.push_back(pivot_first(clauses[i].lits, -x));
+			remove(i);
+		}
+
+		eliminated[x] = true;
+		++nr_eliminated;
+
+		for (const std::vector<int> &c: resolvents)
+			add(c);
+
+		propagate();
+		return true;
+	}
+
+	static std::vector<int> pivot_first(std::vector<int> lits, int x)
+	{
+		std::swap(*std::find(lits.begin(), lits.end(), x), lits[0]);
+		return lits;
+	}
+
+	/* Try every variable, cheapest first; whether any was eliminated */
+	bool eliminate_pass(unsigned int growth)
+	{
+		std::vector<std::pair<unsigned long, int>> candidates;
+		for (int x = 1; x < (int) values.size(); ++x) {
+			if (is_protected[x] || eliminated[x] || values[x])
+				continue;
+
+			unsigned long p = occurrences_of(x).size();
+			unsigned long n = occurrences_of(-x).size();
+			if (p + n == 0 || p + n > ELIMINATE_MAX_OCCURRENCES)
+				continue;
+
+			candidates.push_back(std::make_pair(p * n, x));
+		}
+
+		std::sort(candidates.begin(), candidates.end());
+
+		bool progress = false;
+		for (const auto &it: candidates) {
+			if (empty_clause)
+				break;
+			if (values[it.second])
+				continue;
+
+			progress = eliminate(it.second, growth) || progress;
+		}
+
+		return progress;
+	}
+};
+
+#endif
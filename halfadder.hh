@@ -0,0 +1,75 @@
+#ifndef HALFADDER_HH
+#define HALFADDER_HH
+
+/*
+ * The espresso-minimised half-adder tables in data/.
+ *
+ * halfadder-<n>-<m>.out.txt gives the clauses of a circuit that sums n
+ * input bits into an m-bit number. In the clauses returned here, literal
+ * i (counting from 1) stands for input i - 1 when i <= n and for output
+ * bit m - 1 - (i - 1 - n) otherwise, i.e. the outputs are listed most
+ * significant bit first.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "format.hh"
+#include "trace.hh"
+
+/* Tables loaded so far, by (number of inputs, number of outputs) */
+static std::map<std::pair<unsigned int, unsigned int>, std::vector<std::vector<int>>> halfadder_cache;
+
+static inline const std::vector<std::vector<int>> &halfadder_table(unsigned int n, unsigned int m)
+{
+	auto it = halfadder_cache.find(std::make_pair(n, m));
+	if (it != halfadder_cache.end())
+		return it->second;
+
+	trace_span span("halfadder_table");
+	span.arg("inputs", n);
+	span.arg("outputs", m);
+
+	auto filename = format("data/halfadder-$-$.out.txt", n, m);
+
+	FILE *in = fopen(filename.c_str(), "r");
+	if (!in)
+		throw std::runtime_error("fopen() failed");
+
+	std::vector<std::vector<int>> clauses;
+	while (1) {
+		char buf[512];
+		if (!fgets(buf, sizeof(buf), in))
+			break;
+
+		if (!strncmp(buf, ".i", 2))
+			continue;
+		if (!strncmp(buf, ".o", 2))
+			continue;
+		if (!strncmp(buf, ".p", 2))
+			continue;
+		if (!strncmp(buf, ".e", 2))
+			break;
+
+		std::vector<int> c;
+		for (unsigned int i = 0; i < n + m; ++i) {
+			if (buf[i] == '0')
+				c.push_back(-(i + 1));
+			else if (buf[i] == '1')
+				c.push_back(i + 1);
+		}
+
+		clauses.push_back(c);
+	}
+
+	fclose(in);
+
+	return halfadder_cache.insert(std::make_pair(std::make_pair(n, m), clauses)).first->second;
+}
+
+#endif
@@ -16,7 +16,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
@@ -24,8 +28,10 @@
 #include <cstring>
 #include <ctime>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
@@ -33,12 +39,27 @@
 #include <boost/program_options.hpp>
 
 extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 }
 
+#include "aiger.hh"
+#include "anf.hh"
+#include "arena.hh"
+#include "cache.hh"
+#include "circuit.hh"
+#include "eliminate.hh"
+#include "probe.hh"
 #include "format.hh"
+#include "halfadder.hh"
+#include "predict.hh"
+#include "sha1.hh"
+#include "smt2.hh"
+#include "trace.hh"
 
 
 /* Instance options */
@@ -46,27 +67,84 @@ static std::string config_attack = "preimage";
 static unsigned int config_nr_rounds = 80;
 static unsigned int config_nr_message_bits = 0;
 static unsigned int config_nr_hash_bits = 160;
+static unsigned int config_mine = 0;
 
 /* Format options */
 static bool config_cnf = false;
 static bool config_opb = false;
+static bool config_aiger = false;
+static bool config_smt2 = false;
+static bool config_anf = false;
+static bool config_wcnf = false;
+static std::string config_targets;
+static bool config_null = false;
+static bool config_predict = false;
+static bool config_comments = true;
+static std::string config_map;
+static std::string config_stats;
+static std::string config_trace;
+static std::string config_usage_report;
+static bool config_check = false;
+static std::string config_planted;
+static std::string config_cache;
+static unsigned long config_cache_size = 1024;
+static bool config_cache_compress = false;
+
+/* Set by sha1-satd, whose requests come from anyone who can connect to
+ * its socket: they may not run commands or write files as the daemon */
+static bool config_untrusted_arguments = false;
 
 /* CNF options */
 static bool config_use_xor_clauses = false;
 static bool config_use_halfadder_clauses = false;
 static bool config_use_tseitin_adders = false;
+static bool config_simplify = false;
+static bool config_plaisted_greenbaum = false;
 static bool config_restrict_branching = false;
+static std::string config_shm_solver;
+static bool config_eliminate = false;
+static unsigned int config_eliminate_growth = 0;
+static std::string config_elimination_stack;
+static bool config_probe = false;
+static unsigned int config_probe_budget = 100;
 
 /* OPB options */
 static bool config_use_compact_adders = false;
 
+/* WCNF options; the weight of the soft hash bits of each hash word */
+static std::string config_soft_weights = "1";
+static std::vector<unsigned long> soft_weights;
+
 static std::ostringstream cnf;
 static std::ostringstream opb;
 
+/* Counted for --usage-report. The default operator delete frees with
+ * free(), so it does not need replacing. Not inlined, or GCC sees the
+ * malloc() and warns about every delete in the same file. */
+static unsigned long nr_allocations;
+static unsigned long nr_allocated_bytes;
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+	++nr_allocations;
+	nr_allocated_bytes += size;
+
+	void *ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
 static void comment(std::string str)
 {
-	cnf << format("c $\n", str);
-	opb << format("* $\n", str);
+	if (!config_comments)
+		return;
+
+	if (config_cnf)
+		cnf << format("c $\n", str);
+	if (config_opb)
+		opb << format("* $\n", str);
 }
 
 static int nr_variables = 0;
@@ -74,14 +152,174 @@ static unsigned int nr_clauses = 0;
 static unsigned int nr_xor_clauses = 0;
 static unsigned int nr_constraints = 0;
 
-static void new_vars(std::string label, int x[], unsigned int n, bool decision_var = true)
+enum var_role {
+	ROLE_MESSAGE,
+	ROLE_EXPANSION,
+	ROLE_CHAINING,
+	ROLE_HASH,
+	ROLE_STATE,
+	ROLE_FUNCTION,
+	ROLE_CARRY,
+	ROLE_TEMPORARY,
+	ROLE_CONSTANT,
+};
+
+static const char *var_role_names[] = {
+	"message",
+	"expansion",
+	"chaining",
+	"hash",
+	"state",
+	"function",
+	"carry",
+	"temporary",
+	"constant",
+};
+
+struct var_label {
+	int first;
+	unsigned int width;
+	std::string name;
+	var_role role;
+};
+
+static std::vector<var_label> var_labels;
+
+/* Variables that --probe or --eliminate took out of the instance; a
+ * solution gives them arbitrary values */
+static std::vector<bool> removed_variables;
+
+/* What each part of the encoding adds, for --stats. Everything emitted
+ * is counted against the innermost component_scope. */
+struct component_stats {
+	unsigned long nr_variables;
+	unsigned long nr_clauses;
+	unsigned long nr_literals;
+	unsigned long nr_xor_clauses;
+	unsigned long nr_xor_literals;
+	unsigned long nr_halfadders;
+	unsigned long nr_pb_constraints;
+};
+
+static std::map<std::string, component_stats> components;
+static std::vector<std::string> component_order(1, "other");
+static std::string current_component_name = "other";
+static component_stats *current_component = &components["other"];
+
+/* Number of clauses by length, and (with --stats) the number of clauses,
+ * XORs and half-adders each variable occurs in */
+static std::vector<unsigned long> clause_lengths;
+static std::vector<unsigned int> var_occurrences;
+
+static void set_component(const std::string &name)
+{
+	auto it = components.find(name);
+	if (it == components.end()) {
+		it = components.insert(std::make_pair(name, component_stats())).first;
+		component_order.push_back(name);
+	}
+
+	current_component_name = name;
+	current_component = &it->second;
+}
+
+class component_scope {
+public:
+	component_scope(const std::string &name):
+		saved(current_component_name)
+	{
+		set_component(name);
+	}
+
+	~component_scope()
+	{
+		set_component(saved);
+	}
+
+private:
+	std::string saved;
+};
+
+static void count_clause(const int *v, unsigned int n)
+{
+	current_component->nr_clauses += 1;
+	current_component->nr_literals += n;
+
+	if (clause_lengths.size() <= n)
+		clause_lengths.resize(n + 1);
+	++clause_lengths[n];
+
+	if (!config_stats.empty()) {
+		for (unsigned int i = 0; i < n; ++i)
+			++var_occurrences[abs(v[i])];
+	}
+}
+
+/* In-memory copy of the CNF clauses; only filled in when something other
+ * than the text output needs it. Clause i occupies clause_literals[j] for
+ * clause_offsets[i] <= j < clause_offsets[i + 1]. */
+static bool config_arena = false;
+static std::vector<int> clause_literals;
+static std::vector<uint64_t> clause_offsets(1, 0);
+
+/* --plaisted-greenbaum: the clauses of and2, or2, xor2/3/4 and the
+ * f-functions are held back until the instance is complete, and then only
+ * the clauses for the polarities in which each gate output occurs are
+ * written. A clause with -r says that r implies the gate's function and is
+ * only needed if r occurs positively; a clause with r is only needed if r
+ * occurs negatively. polarities[x] has bit 0 set if x occurs positively
+ * and bit 1 if it occurs negatively (XORs, half-adders and PB constraints
+ * count as both). */
+struct deferred_clause {
+	int r;
+	std::vector<int> literals;
+	component_stats *component;
+};
+
+static std::vector<deferred_clause> deferred_clauses;
+static std::vector<uint8_t> polarities;
+
+static void occurs(int x, uint8_t polarity)
+{
+	if (config_plaisted_greenbaum)
+		polarities[abs(x)] |= polarity;
+}
+
+static void occurs(int x)
+{
+	occurs(x, x > 0 ? 1 : 2);
+}
+
+/* The circuit behind the clauses (--check, --planted, --mine): every
+ * encoding function records how the variables it defines are computed
+ * from its inputs. Lane 0 of the simulation runs on the planted message,
+ * the solution that the instance was built around (if there is one), so
+ * the planted model is complete once the instance is. */
+static bool config_circuit = false;
+static circuit gates;
+
+static bool planted_value(int x)
+{
+	return gates.value(x) & 1;
+}
+
+static void new_vars(std::string label, int x[], unsigned int n, var_role role, bool decision_var = true)
 {
 	for (unsigned int i = 0; i < n; ++i)
 		x[i] = ++nr_variables;
 
+	var_labels.push_back(var_label{x[0], n, label, role});
+	current_component->nr_variables += n;
+	if (!config_stats.empty())
+		var_occurrences.resize(nr_variables + 1);
+	if (config_circuit)
+		gates.resize(nr_variables);
+	if (config_plaisted_greenbaum)
+		polarities.resize(nr_variables + 1);
+
 	comment(format("var $/$ $", x[0], n, label));
 
-	if (config_restrict_branching) {
+	if (config_restrict_branching && config_cnf) {
 		if (decision_var) {
 			for (unsigned int i = 0; i < n; ++i)
 				cnf << format("d $ 0\n", x[i]);
@@ -94,8 +332,23 @@ static void new_vars(std::string label, int x[], unsigned int n, bool decision_v
 
 static void constant(int r, bool value)
 {
-	cnf << format("$$ 0\n", (r < 0) ^ value ? "" : "-", r);
-	opb << format("1 x$ = $;\n", r, (r < 0) ^ value ? 1 : 0);
+	/* Constraints that do not define r (e.g. fixed hash bits) leave it
+	 * alone; the check finds out whether they hold */
+	if (config_circuit)
+		gates.define_constant(r, value);
+
+	if (config_cnf)
+		cnf << format("$$ 0\n", (r < 0) ^ value ? "" : "-", r);
+	if (config_opb)
+		opb << format("1 x$ = $;\n", r, (r < 0) ^ value ? 1 : 0);
+
+	if (config_arena) {
+		clause_literals.push_back((r < 0) ^ value ? r : -r);
+		clause_offsets.push_back(clause_literals.size());
+	}
+
+	occurs((r < 0) ^ value ? r : -r);
+	count_clause(&r, 1);
 
 	nr_clauses += 1;
 	nr_constraints += 1;
@@ -105,17 +358,13 @@ static void constant32(int r[], uint32_t value)
 {
 	comment(format("constant32 ($)", value));
 
-	for (unsigned int i = 0; i < 32; ++i) {
+	for (unsigned int i = 0; i < 32; ++i)
 		constant(r[i], (value >> i) & 1);
-
-		nr_clauses += 1;
-		nr_constraints += 1;
-	}
 }
 
 static void new_constant(std::string label, int r[32], uint32_t value)
 {
-	new_vars(label, r, 32);
+	new_vars(label, r, 32, ROLE_CONSTANT);
 	constant32(r, value);
 }
 
@@ -133,13 +382,29 @@ static void args_to_vector(std::vector<T> &v, T x, Args... args)
 
 static void clause(const std::vector<int> &v)
 {
-	for (int x: v) {
-		cnf << format("$$ ", x < 0 ? "-" : "", abs(x));
-		opb << format("1 $x$ ", x < 0 ? "~" : "", abs(x));
+	if (config_cnf) {
+		for (int x: v)
+			cnf << format("$$ ", x < 0 ? "-" : "", abs(x));
+
+		cnf << format("0\n");
+	}
+
+	if (config_opb) {
+		for (int x: v)
+			opb << format("1 $x$ ", x < 0 ? "~" : "", abs(x));
+
+		opb << format(">= 1;\n");
 	}
 
-	cnf << format("0\n");
-	opb << format(">= 1;\n");
+	if (config_arena) {
+		clause_literals.insert(clause_literals.end(), v.begin(), v.end());
+		clause_offsets.push_back(clause_literals.size());
+	}
+
+	for (int x: v)
+		occurs(x);
+
+	count_clause(v.data(), v.size());
 
 	nr_clauses += 1;
 	nr_constraints += 1;
@@ -153,14 +418,40 @@ static void clause(Args... args)
 	clause(v);
 }
 
+/* A clause of the gate that defines r */
+template<typename... Args>
+static void gate_clause(int r, Args... args)
+{
+	std::vector<int> v;
+	args_to_vector(v, args...);
+
+	if (config_plaisted_greenbaum)
+		deferred_clauses.push_back(deferred_clause{r, v, current_component});
+	else
+		clause(v);
+}
+
 static void xor_clause(const std::vector<int> &v)
 {
-	cnf << format("x ");
+	if (config_cnf) {
+		cnf << format("x ");
+
+		for (int x: v)
+			cnf << format("$$ ", x < 0 ? "-" : "", abs(x));
+
+		cnf << format("0\n");
+	}
 
 	for (int x: v)
-		cnf << format("$$ ", x < 0 ? "-" : "", abs(x));
+		occurs(x, 3);
+
+	current_component->nr_xor_clauses += 1;
+	current_component->nr_xor_literals += v.size();
 
-	cnf << format("0\n");
+	if (!config_stats.empty()) {
+		for (int x: v)
+			++var_occurrences[abs(x)];
+	}
 
 	nr_xor_clauses += 1;
 }
@@ -173,68 +464,86 @@ static void xor_clause(Args... args)
 	xor_clause(v);
 }
 
-static void halfadder(const std::vector<int> &lhs, const std::vector<int> &rhs)
+/* With --simplify, a gate whose output turned out to be a constant or
+ * equal to an earlier literal is encoded as that instead */
+static bool lowered(int r)
 {
-	if (config_use_halfadder_clauses) {
-		cnf << "h ";
+	if (!config_simplify)
+		return false;
+
+	int x = gates.replacement(r);
+	if (!x)
+		return false;
+
+	if (x == CIRCUIT_TRUE) {
+		clause(r);
+	} else if (x == -CIRCUIT_TRUE) {
+		clause(-r);
+	} else if (config_use_xor_clauses) {
+		xor_clause(-r, x);
+	} else {
+		clause(-r, x);
+		clause(r, -x);
+	}
 
-		for (int x: lhs)
-			cnf << format("$ ", x);
+	return true;
+}
 
-		cnf << "0 ";
+/* Sums are simplified as a whole */
+static bool lowered(const std::vector<int> &r)
+{
+	if (!config_simplify || !gates.replacement(r[0]))
+		return false;
 
-		for (int x: rhs)
-			cnf << format("$ ", x);
+	for (int x: r)
+		lowered(x);
 
-		cnf << "0\n";
-	} else {
-		static std::map<std::pair<unsigned int, unsigned int>, std::vector<std::vector<int>>> cache;
+	return true;
+}
 
-		unsigned int n = lhs.size();
-		unsigned int m = rhs.size();
+static void halfadder(const std::vector<int> &lhs, const std::vector<int> &rhs)
+{
+	if (config_circuit)
+		gates.define_sum(rhs, lhs, std::vector<uint8_t>(lhs.size(), 0));
 
-		std::vector<std::vector<int>> clauses;
-		auto it = cache.find(std::make_pair(n, m));
-		if (it != cache.end()) {
-			clauses = it->second;
-		} else {
-			auto filename = format("data/halfadder-$-$.out.txt", n, m);
+	if (lowered(rhs))
+		return;
 
-			FILE *in = fopen(filename.c_str(), "r");
-			if (!in)
-				throw std::runtime_error("fopen() failed");
+	if (config_use_halfadder_clauses) {
+		if (config_cnf) {
+			cnf << "h ";
 
-			while (1) {
-				char buf[512];
-				if (!fgets(buf, sizeof(buf), in))
-					break;
+			for (int x: lhs)
+				cnf << format("$ ", x);
 
-				if (!strncmp(buf, ".i", 2))
-					continue;
-				if (!strncmp(buf, ".o", 2))
-					continue;
-				if (!strncmp(buf, ".p", 2))
-					continue;
-				if (!strncmp(buf, ".e", 2))
-					break;
-	
-				std::vector<int> c;
-				for (int i = 0; i < n + m; ++i) {
-					if (buf[i] == '0')
-						c.push_back(-(i + 1));
-					else if (buf[i] == '1')
-						c.push_back(i + 1);
-				}
+			cnf << "0 ";
 
-				clauses.push_back(c);
-			}
+			for (int x: rhs)
+				cnf << format("$ ", x);
 
-			fclose(in);
+			cnf << "0\n";
+		}
+
+		for (int x: lhs)
+			occurs(x, 3);
+		for (int x: rhs)
+			occurs(x, 3);
 
-			cache.insert(std::make_pair(std::make_pair(n, m), clauses));
+		current_component->nr_halfadders += 1;
+
+		if (!config_stats.empty()) {
+			for (int x: lhs)
+				++var_occurrences[x];
+			for (int x: rhs)
+				++var_occurrences[x];
 		}
+	} else {
+		unsigned int n = lhs.size();
+		unsigned int m = rhs.size();
 
-		for (std::vector<int> &c: clauses) {
+		const std::vector<std::vector<int>> &clauses = halfadder_table(n, m);
+
+		for (const std::vector<int> &c: clauses) {
 			std::vector<int> real_clause;
 
 			for (int i: c) {
@@ -247,14 +556,21 @@ static void halfadder(const std::vector<int> &lhs, const std::vector<int> &rhs)
 		}
 	}
 
-	for (int x: lhs)
-		opb << format("1 x$ ", x);
+	if (config_opb) {
+		for (int x: lhs) {
+			opb << format("1 x$ ", x);
+			occurs(x, 3);
+		}
 
-	for (unsigned int i = 0; i < rhs.size(); ++i)
-		opb << format("-$ x$ ", 1U << i, rhs[i]);
+		for (unsigned int i = 0; i < rhs.size(); ++i) {
+			opb << format("-$ x$ ", 1U << i, rhs[i]);
+			occurs(rhs[i], 3);
+		}
 
-	opb << format("= 0;\n");
+		opb << format("= 0;\n");
+	}
 
+	current_component->nr_pb_constraints += 1;
 	nr_constraints += 1;
 }
 
@@ -262,16 +578,26 @@ static void xor2(int r[], int a[], int b[], unsigned int n)
 {
 	comment("xor2");
 
-	if (config_use_xor_clauses) {
+	if (config_circuit) {
 		for (unsigned int i = 0; i < n; ++i)
-			xor_clause(-r[i], a[i], b[i]);
+			gates.define(GATE_XOR, r[i], {a[i], b[i]});
+	}
+
+	if (config_use_xor_clauses) {
+		for (unsigned int i = 0; i < n; ++i) {
+			if (!lowered(r[i]))
+				xor_clause(-r[i], a[i], b[i]);
+		}
 	} else {
 		for (unsigned int i = 0; i < n; ++i) {
+			if (lowered(r[i]))
+				continue;
+
 			for (unsigned int j = 0; j < 8; ++j) {
 				if (__builtin_popcount(j ^ 1) % 2 == 1)
 					continue;
 
-				clause((j & 1) ? -r[i] : r[i],
+				gate_clause(r[i], (j & 1) ? -r[i] : r[i],
 					(j & 2) ? a[i] : -a[i],
 					(j & 4) ? b[i] : -b[i]);
 			}
@@ -283,16 +609,26 @@ static void xor3(int r[], int a[], int b[], int c[], unsigned int n = 32)
 {
 	comment("xor3");
 
-	if (config_use_xor_clauses) {
+	if (config_circuit) {
 		for (unsigned int i = 0; i < n; ++i)
-			xor_clause(-r[i], a[i], b[i], c[i]);
+			gates.define(GATE_XOR, r[i], {a[i], b[i], c[i]});
+	}
+
+	if (config_use_xor_clauses) {
+		for (unsigned int i = 0; i < n; ++i) {
+			if (!lowered(r[i]))
+				xor_clause(-r[i], a[i], b[i], c[i]);
+		}
 	} else {
 		for (unsigned int i = 0; i < n; ++i) {
+			if (lowered(r[i]))
+				continue;
+
 			for (unsigned int j = 0; j < 16; ++j) {
 				if (__builtin_popcount(j ^ 1) % 2 == 0)
 					continue;
 
-				clause((j & 1) ? -r[i] : r[i],
+				gate_clause(r[i], (j & 1) ? -r[i] : r[i],
 					(j & 2) ? a[i] : -a[i],
 					(j & 4) ? b[i] : -b[i],
 					(j & 8) ? c[i] : -c[i]);
@@ -305,16 +641,26 @@ static void xor4(int r[32], int a[32], int b[32], int c[32], int d[32])
 {
 	comment("xor4");
 
-	if (config_use_xor_clauses) {
+	if (config_circuit) {
 		for (unsigned int i = 0; i < 32; ++i)
-			xor_clause(-r[i], a[i], b[i], c[i], d[i]);
+			gates.define(GATE_XOR, r[i], {a[i], b[i], c[i], d[i]});
+	}
+
+	if (config_use_xor_clauses) {
+		for (unsigned int i = 0; i < 32; ++i) {
+			if (!lowered(r[i]))
+				xor_clause(-r[i], a[i], b[i], c[i], d[i]);
+		}
 	} else {
 		for (unsigned int i = 0; i < 32; ++i) {
+			if (lowered(r[i]))
+				continue;
+
 			for (unsigned int j = 0; j < 32; ++j) {
 				if (__builtin_popcount(j ^ 1) % 2 == 1)
 					continue;
 
-				clause((j & 1) ? -r[i] : r[i],
+				gate_clause(r[i], (j & 1) ? -r[i] : r[i],
 					(j & 2) ? a[i] : -a[i],
 					(j & 4) ? b[i] : -b[i],
 					(j & 8) ? c[i] : -c[i],
@@ -352,20 +698,53 @@ static void neq(int a[], int b[], unsigned int n = 32)
 
 static void and2(int r[], int a[], int b[], unsigned int n)
 {
+	if (config_circuit) {
+		for (unsigned int i = 0; i < n; ++i)
+			gates.define(GATE_AND, r[i], {a[i], b[i]});
+	}
+
 	for (unsigned int i = 0; i < n; ++i) {
-		clause(r[i], -a[i], -b[i]);
-		clause(-r[i], a[i]);
-		clause(-r[i], b[i]);
+		if (lowered(r[i]))
+			continue;
+
+		gate_clause(r[i], r[i], -a[i], -b[i]);
+		gate_clause(r[i], -r[i], a[i]);
+		gate_clause(r[i], -r[i], b[i]);
 	}
 }
 
 static void or2(int r[], int a[], int b[], unsigned int n)
 {
+	if (config_circuit) {
+		for (unsigned int i = 0; i < n; ++i)
+			gates.define(GATE_OR, r[i], {a[i], b[i]});
+	}
+
 	for (unsigned int i = 0; i < n; ++i) {
-		clause(-r[i], a[i], b[i]);
-		clause(r[i], -a[i]);
-		clause(r[i], -b[i]);
+		if (lowered(r[i]))
+			continue;
+
+		gate_clause(r[i], -r[i], a[i], b[i]);
+		gate_clause(r[i], r[i], -a[i]);
+		gate_clause(r[i], r[i], -b[i]);
+	}
+}
+
+/* r and the overflow bits o are the sum of the words */
+static void define_word_sum(std::initializer_list<const int *> words, int r[32], int o[], unsigned int nr_overflow)
+{
+	std::vector<int> inputs;
+	std::vector<uint8_t> shifts;
+	for (const int *x: words) {
+		for (unsigned int i = 0; i < 32; ++i) {
+			inputs.push_back(x[i]);
+			shifts.push_back(i);
+		}
 	}
+
+	std::vector<int> outputs(r, r + 32);
+	outputs.insert(outputs.end(), o, o + nr_overflow);
+	gates.define_sum(outputs, inputs, shifts);
 }
 
 static void add2(std::string label, int r[32], int a[32], int b[32])
@@ -374,16 +753,32 @@ static void add2(std::string label, int r[32], int a[32], int b[32])
 
 	if (config_use_tseitin_adders) {
 		int c[31];
-		new_vars("carry", c, 31);
+		new_vars("carry", c, 31, ROLE_CARRY);
 
 		int t0[31];
-		new_vars("t0", t0, 31);
+		new_vars("t0", t0, 31, ROLE_TEMPORARY);
 
 		int t1[31];
-		new_vars("t1", t1, 31);
+		new_vars("t1", t1, 31, ROLE_TEMPORARY);
 
 		int t2[31];
-		new_vars("t2", t2, 31);
+		new_vars("t2", t2, 31, ROLE_TEMPORARY);
+
+		/* The gates below are emitted a vector at a time, but the
+		 * carries ripple, so they are defined bit by bit first */
+		if (config_circuit) {
+			gates.define(GATE_AND, c[0], {a[0], b[0]});
+			gates.define(GATE_XOR, r[0], {a[0], b[0]});
+
+			for (unsigned int i = 1; i < 32; ++i) {
+				gates.define(GATE_XOR, t0[i - 1], {a[i], b[i]});
+				gates.define(GATE_AND, t1[i - 1], {a[i], b[i]});
+				gates.define(GATE_AND, t2[i - 1], {t0[i - 1], c[i - 1]});
+				if (i < 31)
+					gates.define(GATE_OR, c[i], {t1[i - 1], t2[i - 1]});
+				gates.define(GATE_XOR, r[i], {t0[i - 1], c[i - 1]});
+			}
+		}
 
 		and2(c, a, b, 1);
 		xor2(r, a, b, 1);
@@ -394,16 +789,39 @@ static void add2(std::string label, int r[32], int a[32], int b[32])
 		or2(&c[1], t1, t2, 30);
 		xor2(&r[1], t0, c, 31);
 	} else if (config_use_compact_adders) {
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, a[i]);
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, b[i]);
+		/* The bit that falls off the end of the 32-bit sum */
+		int o[1];
+		new_vars(format("$_overflow", label), o, 1, ROLE_CARRY);
 
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("-$ x$ ", 1UL << i, r[i]);
+		if (config_circuit)
+			define_word_sum({a, b}, r, o, 1);
 
-		opb << format("= 0;\n");
+		std::vector<int> outputs(r, r + 32);
+		outputs.push_back(o[0]);
+		if (lowered(outputs))
+			return;
 
+		for (unsigned int i = 0; i < 32; ++i) {
+			occurs(a[i], 3);
+			occurs(b[i], 3);
+		}
+		for (int x: outputs)
+			occurs(x, 3);
+
+		if (config_opb) {
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, a[i]);
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, b[i]);
+
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("-$ x$ ", 1UL << i, r[i]);
+			opb << format("-$ x$ ", 1UL << 32, o[0]);
+
+			opb << format("= 0;\n");
+		}
+
+		current_component->nr_pb_constraints += 1;
 		++nr_constraints;
 	} else {
 		std::vector<int> addends[32 + 5];
@@ -414,7 +832,7 @@ static void add2(std::string label, int r[32], int a[32], int b[32])
 			unsigned int m = floor(log2(addends[i].size()));
 			std::vector<int> rhs(1 + m);
 			rhs[0] = r[i];
-			new_vars(format("$_rhs[$]", label, i), &rhs[1], m);
+			new_vars(format("$_rhs[$]", label, i), &rhs[1], m, ROLE_CARRY);
 
 			for (unsigned int j = 1; j < 1 + m; ++j)
 				addends[i + j].push_back(rhs[j]);
@@ -430,35 +848,62 @@ static void add5(std::string label, int r[32], int a[32], int b[32], int c[32],
 
 	if (config_use_tseitin_adders) {
 		int t0[32];
-		new_vars("t0", t0, 32);
+		new_vars("t0", t0, 32, ROLE_TEMPORARY);
 
 		int t1[32];
-		new_vars("t1", t1, 32);
+		new_vars("t1", t1, 32, ROLE_TEMPORARY);
 
 		int t2[32];
-		new_vars("t2", t2, 32);
+		new_vars("t2", t2, 32, ROLE_TEMPORARY);
 
 		add2(label, t0, a, b);
 		add2(label, t1, c, d);
 		add2(label, t2, t0, t1);
 		add2(label, r, t2, e);
 	} else if (config_use_compact_adders) {
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, a[i]);
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, b[i]);
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, c[i]);
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, d[i]);
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("$ x$ ", 1L << i, e[i]);
+		/* The sum of five words needs three more bits */
+		int o[3];
+		new_vars(format("$_overflow", label), o, 3, ROLE_CARRY);
 
-		for (unsigned int i = 0; i < 32; ++i)
-			opb << format("-$ x$ ", 1UL << i, r[i]);
+		if (config_circuit)
+			define_word_sum({a, b, c, d, e}, r, o, 3);
 
-		opb << format("= 0;\n");
+		std::vector<int> outputs(r, r + 32);
+		outputs.insert(outputs.end(), o, o + 3);
+		if (lowered(outputs))
+			return;
+
+		for (unsigned int i = 0; i < 32; ++i) {
+			occurs(a[i], 3);
+			occurs(b[i], 3);
+			occurs(c[i], 3);
+			occurs(d[i], 3);
+			occurs(e[i], 3);
+		}
+		for (int x: outputs)
+			occurs(x, 3);
+
+		if (config_opb) {
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, a[i]);
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, b[i]);
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, c[i]);
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, d[i]);
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("$ x$ ", 1L << i, e[i]);
+
+			for (unsigned int i = 0; i < 32; ++i)
+				opb << format("-$ x$ ", 1UL << i, r[i]);
+			for (unsigned int i = 0; i < 3; ++i)
+				opb << format("-$ x$ ", 1UL << (32 + i), o[i]);
+
+			opb << format("= 0;\n");
+		}
 
+		current_component->nr_pb_constraints += 1;
 		++nr_constraints;
 	} else {
 		std::vector<int> addends[32 + 5];
@@ -472,7 +917,7 @@ static void add5(std::string label, int r[32], int a[32], int b[32], int c[32],
 			unsigned int m = floor(log2(addends[i].size()));
 			std::vector<int> rhs(1 + m);
 			rhs[0] = r[i];
-			new_vars(format("$_rhs[$]", label, i), &rhs[1], m);
+			new_vars(format("$_rhs[$]", label, i), &rhs[1], m, ROLE_CARRY);
 
 			for (unsigned int j = 1; j < 1 + m; ++j)
 				addends[i + j].push_back(rhs[j]);
@@ -490,46 +935,76 @@ static void rotl(int r[32], int x[32], unsigned int n)
 
 class sha1 {
 public:
+	std::string name;
+
 	int w[80][32];
 	int h_in[5][32];
 	int h_out[5][32];
 
 	int a[85][32];
 
-	sha1(unsigned int nr_rounds, std::string name)
+	/* message is the planted message, if there is one */
+	sha1(unsigned int nr_rounds, std::string name, const uint32_t *message = 0):
+		name(name)
 	{
+		trace_span span("sha1");
+
 		comment("sha1");
 		comment(format("parameter nr_rounds = $", nr_rounds));
 
+		component_scope scope("message");
+
 		for (unsigned int i = 0; i < 16; ++i)
-			new_vars(format("w$[$]", name, i), w[i], 32, !config_restrict_branching);
+			new_vars(format("w$[$]", name, i), w[i], 32, ROLE_MESSAGE, !config_restrict_branching);
+
+		/* The other lanes get random messages */
+		if (config_circuit) {
+			for (unsigned int i = 0; i < 16; ++i) {
+				for (unsigned int j = 0; j < 32; ++j) {
+					uint64_t value = gates.random_value();
+					if (message)
+						value = (value & ~1UL) | ((message[i] >> j) & 1);
+
+					gates.define_input(w[i][j], value);
+				}
+			}
+		}
 
 		/* XXX: Fix this later by writing directly to w[i] */
 		int wt[80][32];
+		set_component("expansion");
 		for (unsigned int i = 16; i < nr_rounds; ++i)
-			new_vars(format("w$[$]", name, i), wt[i], 32);
-
-		new_vars(format("h$_in0", name), h_in[0], 32);
-		new_vars(format("h$_in1", name), h_in[1], 32);
-		new_vars(format("h$_in2", name), h_in[2], 32);
-		new_vars(format("h$_in3", name), h_in[3], 32);
-		new_vars(format("h$_in4", name), h_in[4], 32);
-
-		new_vars(format("h$_out0", name), h_out[0], 32);
-		new_vars(format("h$_out1", name), h_out[1], 32);
-		new_vars(format("h$_out2", name), h_out[2], 32);
-		new_vars(format("h$_out3", name), h_out[3], 32);
-		new_vars(format("h$_out4", name), h_out[4], 32);
-
+			new_vars(format("w$[$]", name, i), wt[i], 32, ROLE_EXPANSION);
+
+		set_component("constants");
+		new_vars(format("h$_in0", name), h_in[0], 32, ROLE_CHAINING);
+		new_vars(format("h$_in1", name), h_in[1], 32, ROLE_CHAINING);
+		new_vars(format("h$_in2", name), h_in[2], 32, ROLE_CHAINING);
+		new_vars(format("h$_in3", name), h_in[3], 32, ROLE_CHAINING);
+		new_vars(format("h$_in4", name), h_in[4], 32, ROLE_CHAINING);
+
+		set_component("feed_forward");
+		new_vars(format("h$_out0", name), h_out[0], 32, ROLE_HASH);
+		new_vars(format("h$_out1", name), h_out[1], 32, ROLE_HASH);
+		new_vars(format("h$_out2", name), h_out[2], 32, ROLE_HASH);
+		new_vars(format("h$_out3", name), h_out[3], 32, ROLE_HASH);
+		new_vars(format("h$_out4", name), h_out[4], 32, ROLE_HASH);
+
+		set_component("round_adders");
 		for (unsigned int i = 0; i < nr_rounds; ++i)
-			new_vars(format("a[$]", i + 5), a[i + 5], 32);
+			new_vars(format("a[$]", i + 5), a[i + 5], 32, ROLE_STATE);
 
+		set_component("expansion");
+		std::unique_ptr<trace_span> phase(new trace_span("message_expansion"));
 		for (unsigned int i = 16; i < nr_rounds; ++i) {
 			xor4(wt[i], w[i - 3], w[i - 8], w[i - 14], w[i - 16]);
 			rotl(w[i], wt[i], 1);
 		}
 
 		/* Fix constants */
+		set_component("constants");
+		phase.reset();
+		phase.reset(new trace_span("constants"));
 		int k[4][32];
 		new_constant("k[0]", k[0], 0x5a827999);
 		new_constant("k[1]", k[1], 0x6ed9eba1);
@@ -549,6 +1024,14 @@ public:
 		rotl(a[0], h_in[4], 32 - 30);
 
 		for (unsigned int i = 0; i < nr_rounds; ++i) {
+			/* One span per 20 rounds (one f-function) */
+			if (i % 20 == 0) {
+				phase.reset();
+				phase.reset(new trace_span("rounds"));
+				phase->arg("first", i);
+				phase->arg("last", std::min(i + 19, nr_rounds - 1));
+			}
+
 			int prev_a[32];
 			rotl(prev_a, a[i + 4], 5);
 
@@ -564,39 +1047,57 @@ public:
 			int e[32];
 			rotl(e, a[i + 0], 30);
 
+			set_component(format("f[$-$]", i / 20 * 20, i / 20 * 20 + 19));
+
 			int f[32];
-			new_vars(format("f[$]", i), f, 32);
+			new_vars(format("f[$]", i), f, 32, ROLE_FUNCTION);
+
+			if (config_circuit && (i < 20 || (i >= 40 && i < 60))) {
+				for (unsigned int j = 0; j < 32; ++j)
+					gates.define(i < 20 ? GATE_CH : GATE_MAJ, f[j], {b[j], c[j], d[j]});
+			}
 
 			if (i >= 0 && i < 20) {
 				for (unsigned int j = 0; j < 32; ++j) {
-					clause(-f[j], -b[j], c[j]);
-					clause(-f[j], b[j], d[j]);
-					clause(-f[j], c[j], d[j]);
+					if (lowered(f[j]))
+						continue;
+
+					gate_clause(f[j], -f[j], -b[j], c[j]);
+					gate_clause(f[j], -f[j], b[j], d[j]);
+					gate_clause(f[j], -f[j], c[j], d[j]);
 
-					clause(f[j], -b[j], -c[j]);
-					clause(f[j], b[j], -d[j]);
-					clause(f[j], -c[j], -d[j]);
+					gate_clause(f[j], f[j], -b[j], -c[j]);
+					gate_clause(f[j], f[j], b[j], -d[j]);
+					gate_clause(f[j], f[j], -c[j], -d[j]);
 				}
 			} else if (i >= 20 && i < 40) {
 				xor3(f, b, c, d);
 			} else if (i >= 40 && i < 60) {
 				for (unsigned int j = 0; j < 32; ++j) {
-					clause(-f[j], b[j], c[j]);
-					clause(-f[j], b[j], d[j]);
-					clause(-f[j], c[j], d[j]);
+					if (lowered(f[j]))
+						continue;
 
-					clause(f[j], -b[j], -c[j]);
-					clause(f[j], -b[j], -d[j]);
-					clause(f[j], -c[j], -d[j]);
+					gate_clause(f[j], -f[j], b[j], c[j]);
+					gate_clause(f[j], -f[j], b[j], d[j]);
+					gate_clause(f[j], -f[j], c[j], d[j]);
+
+					gate_clause(f[j], f[j], -b[j], -c[j]);
+					gate_clause(f[j], f[j], -b[j], -d[j]);
+					gate_clause(f[j], f[j], -c[j], -d[j]);
 					//clause(f[j], -b[j], -c[j], -d[j]);
 				}
 			} else if (i >= 60 && i < 80) {
 				xor3(f, b, c, d);
 			}
 
+			set_component("round_adders");
 			add5(format("a[$]", i + 5), a[i + 5], prev_a, f, e, k[i / 20], w[i]);
 		}
 
+		set_component("feed_forward");
+		phase.reset();
+		phase.reset(new trace_span("feed_forward"));
+
 		/* Rotate back */
 		int c[32];
 		rotl(c, a[nr_rounds + 2], 30);
@@ -616,204 +1117,1734 @@ public:
 
 };
 
-static uint32_t rotl(uint32_t x, unsigned int n)
+static void sha1_forward(unsigned int nr_rounds, const uint32_t w[16], uint32_t h_out[5])
 {
-	return (x << n) | (x >> (32 - n));
+	memcpy(h_out, sha1_iv, sizeof(sha1_iv));
+	sha1_compress(nr_rounds, h_out, w);
 }
 
-static void sha1_forward(unsigned int nr_rounds, uint32_t w[80], uint32_t h_out[5])
-{
-	uint32_t h0 = 0x67452301;
-	uint32_t h1 = 0xEFCDAB89;
-	uint32_t h2 = 0x98BADCFE;
-	uint32_t h3 = 0x10325476;
-	uint32_t h4 = 0xC3D2E1F0;
+/* The constraints placed on message and hash bits by the attacks, kept
+ * for the symbol map so that verifiers can check them */
+struct target_constraint {
+	const char *type;
+	std::string name;
+	std::string other;
+	unsigned int bit;
+	bool value;
+
+	/* The variables */
+	int x;
+	int y;
+};
 
-	for (unsigned int i = 16; i < nr_rounds; ++i)
-		w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+static std::vector<target_constraint> target_constraints;
 
-	uint32_t a = h0;
-	uint32_t b = h1;
-	uint32_t c = h2;
-	uint32_t d = h3;
-	uint32_t e = h4;
+/* The constraints are also written as comments, so that the verifiers
+ * can check them when they are given the instance instead of the map */
+static void constraint_comment(const target_constraint &c)
+{
+	if (c.other.empty())
+		comment(format("constraint $ $ $ $", c.type, c.name, c.bit, c.value ? 1 : 0));
+	else
+		comment(format("constraint $ $ $ $", c.type, c.name, c.other, c.bit));
+}
 
-	for (unsigned int i = 0; i < nr_rounds; ++i) {
-		uint32_t f, k;
+static void fix_bit(std::string name, int x[32], unsigned int bit, bool value)
+{
+	component_scope scope("target");
 
-		if (i >= 0 && i < 20) {
-			f = (b & c) | (~b & d);
-			k = 0x5A827999;
-		} else if (i >= 20 && i < 40) {
-			f = b ^ c ^ d;
-			k = 0x6ED9EBA1;
-		} else if (i >= 40 && i < 60) {
-			f = (b & c) | (b & d) | (c & d);
-			k = 0x8F1BBCDC;
-		} else if (i >= 60 && i < 80) {
-			f = b ^ c ^ d;
-			k = 0xCA62C1D6;
-		}
+	constant(x[bit], value);
+	target_constraints.push_back(target_constraint{"fixed", name, "", bit, value, x[bit], 0});
+	constraint_comment(target_constraints.back());
+}
 
-		uint32_t t = rotl(a, 5) + f + e + k + w[i];
-		e = d;
-		d = c;
-		c = rotl(b, 30);
-		b = a;
-		a = t;
-	}
+static void equal_bit(std::string name, int x[32], std::string other, int y[32], unsigned int bit)
+{
+	component_scope scope("target");
 
-	h_out[0] = h0 + a;
-	h_out[1] = h1 + b;
-	h_out[2] = h2 + c;
-	h_out[3] = h3 + d;
-	h_out[4] = h4 + e;
+	eq(&x[bit], &y[bit], 1);
+	target_constraints.push_back(target_constraint{"equal", name, other, bit, false, x[bit], y[bit]});
+	constraint_comment(target_constraints.back());
 }
 
-static void preimage()
+static void differ_bit(std::string name, int x[32], std::string other, int y[32], unsigned int bit)
 {
-	sha1 f(config_nr_rounds, "");
+	component_scope scope("target");
 
-	/* Generate a known-valid (message, hash)-pair */
-	uint32_t w[80];
-	for (unsigned int i = 0; i < 16; ++i)
-		w[i] = lrand48();
+	neq(&x[bit], &y[bit], 1);
+	target_constraints.push_back(target_constraint{"differ", name, other, bit, false, x[bit], y[bit]});
+	constraint_comment(target_constraints.back());
+}
 
+/* --targets: the hash values of which a preimage is wanted */
+struct hash_target {
 	uint32_t h[5];
-	sha1_forward(config_nr_rounds, w, h);
+};
 
-	/* Fix message bits */
-	comment(format("Fix $ message bits", config_nr_message_bits));
+static std::vector<hash_target> targets;
 
-	std::vector<unsigned int> message_bits(512);
-	for (unsigned int i = 0; i < 512; ++i)
-		message_bits[i] = i;
+/* The hash word name ("h_out") and the hash bits (32 * word + bit) that
+ * must equal those of one of the targets, for the symbol map */
+static std::string target_hash_name;
+static std::vector<unsigned int> target_hash_bits;
 
-	std::random_shuffle(message_bits.begin(), message_bits.end());
-	for (unsigned int i = 0; i < config_nr_message_bits; ++i) {
-		unsigned int r = message_bits[i] / 32;
-		unsigned int s = message_bits[i] % 32;
+/* "3,17,..." and "<hash>,<hash>,..." for the map and the comments */
+static std::string target_bits_list()
+{
+	std::string r;
+	for (unsigned int b: target_hash_bits)
+		r += format(r.empty() ? "$" : ",$", b);
+	return r;
+}
 
-		constant(f.w[r][s], (w[r] >> s) & 1);
+static std::string target_hashes_list(const char *quote)
+{
+	std::string r;
+	for (const hash_target &t: targets) {
+		char buf[41];
+		snprintf(buf, sizeof(buf), "%08x%08x%08x%08x%08x", t.h[0], t.h[1], t.h[2], t.h[3], t.h[4]);
+		r += format(r.empty() ? "$$$" : ",$$$", quote, buf, quote);
 	}
+	return r;
+}
 
-	/* Fix hash bits */
-	comment(format("Fix $ hash bits", config_nr_hash_bits));
-
-	std::vector<unsigned int> hash_bits(160);
-	for (unsigned int i = 0; i < 160; ++i)
-		hash_bits[i] = i;
-
-	std::random_shuffle(hash_bits.begin(), hash_bits.end());
-	for (unsigned int i = 0; i < config_nr_hash_bits; ++i) {
-		unsigned int r = hash_bits[i] / 32;
-		unsigned int s = hash_bits[i] % 32;
-
-		constant(f.h_out[r][s], (h[r] >> s) & 1);
+/* One hash per line, as 40 hex digits; empty lines and lines starting
+ * with # are skipped */
+static void read_targets(const std::string &filename)
+{
+	std::ifstream in(filename.c_str());
+	if (!in)
+		throw std::runtime_error(format("could not open $", filename));
+
+	std::string line;
+	for (unsigned int line_nr = 1; std::getline(in, line); ++line_nr) {
+		while (!line.empty() && isspace((unsigned char) line.back()))
+			line.pop_back();
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		if (line.size() != 40 || line.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+			throw std::runtime_error(format("$:$: expected a hash of 40 hex digits", filename, line_nr));
+
+		hash_target t;
+		for (unsigned int i = 0; i < 5; ++i)
+			t.h[i] = strtoul(line.substr(8 * i, 8).c_str(), 0, 16);
+		targets.push_back(t);
 	}
+
+	if (targets.empty())
+		throw std::runtime_error(format("$: no targets", filename));
 }
 
-/* The second preimage differs from the first preimage by flipping one of
- * the message bits. */
-static void second_preimage()
+/* Constrain the given hash bits to equal those of at least one target.
+ *
+ * The targets form a trie over the hash bits (in the given order) in
+ * which every chain of single children is one edge, and each edge gets a
+ * selector variable that implies the bits along it. Every selected node
+ * selects at least one of its children, and the root's children are the
+ * top-level at-least-one clause, so the selectors that are true include
+ * a path to some target. Targets that differ early are just selectors
+ * with a unit implication per bit; common prefixes are only encoded
+ * once. */
+static void match_targets(sha1 &f, const std::vector<unsigned int> &hash_bits)
 {
-	sha1 f(config_nr_rounds, "");
+	component_scope scope("target");
 
-	/* Generate a known-valid (message, hash)-pair */
-	uint32_t w[80];
-	for (unsigned int i = 0; i < 16; ++i)
-		w[i] = lrand48();
+	comment(format("Match $ hash bits against $ targets", hash_bits.size(), targets.size()));
 
-	uint32_t h[5];
-	sha1_forward(config_nr_rounds, w, h);
+	target_hash_name = format("h$_out", f.name);
+	target_hash_bits = hash_bits;
+	comment(format("constraint one_of $ $ $", target_hash_name, target_bits_list(), target_hashes_list("")));
 
-	/* Fix message bits */
-	comment(format("Fix $ message bits", config_nr_message_bits));
+	unsigned int n = hash_bits.size();
 
-	std::vector<unsigned int> message_bits(512);
-	for (unsigned int i = 0; i < 512; ++i)
-		message_bits[i] = i;
+	/* The target bits, sorted, so that every trie node is a range */
+	std::vector<std::string> keys;
+	for (const hash_target &t: targets) {
+		std::string key;
+		for (unsigned int b: hash_bits)
+			key += (t.h[b / 32] >> (b % 32)) & 1 ? '1' : '0';
+		keys.push_back(key);
+	}
+
+	std::sort(keys.begin(), keys.end());
+	keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+	/* An edge: the bits [first, last) of keys[key], below parent
+	 * (-1 for the root) */
+	struct trie_edge {
+		int parent;
+		unsigned int first;
+		unsigned int last;
+		unsigned int key;
+	};
+
+	std::vector<trie_edge> edges;
+
+	std::function<void(unsigned int, unsigned int, unsigned int, int)> build =
+		[&](unsigned int lo, unsigned int hi, unsigned int first, int parent)
+	{
+		while (lo < hi) {
+			/* The keys starting with the same bit as keys[lo] */
+			unsigned int mid = lo + 1;
+			while (mid < hi && keys[mid][first] == keys[lo][first])
+				++mid;
+
+			unsigned int last = first + 1;
+			while (last < n && keys[lo][last] == keys[mid - 1][last])
+				++last;
+
+			int edge = edges.size();
+			edges.push_back(trie_edge{parent, first, last, lo});
+
+			if (last < n)
+				build(lo, mid, last, edge);
+
+			lo = mid;
+		}
+	};
+
+	if (n)
+		build(0, keys.size(), 0, -1);
+
+	std::vector<int> selectors(edges.size());
+	if (!edges.empty())
+		new_vars("targets", &selectors[0], edges.size(), ROLE_TEMPORARY);
+
+	std::vector<std::vector<int>> children(edges.size() + 1);
+	for (unsigned int i = 0; i < edges.size(); ++i) {
+		const trie_edge &e = edges[i];
+
+		for (unsigned int j = e.first; j < e.last; ++j) {
+			unsigned int r = hash_bits[j] / 32;
+			unsigned int s = hash_bits[j] % 32;
+
+			clause(-selectors[i], keys[e.key][j] == '1' ? f.h_out[r][s] : -f.h_out[r][s]);
+		}
+
+		children[e.parent + 1].push_back(selectors[i]);
+	}
+
+	for (unsigned int i = 0; i <= edges.size(); ++i) {
+		if (children[i].empty())
+			continue;
+
+		std::vector<int> c = children[i];
+		if (i > 0)
+			c.insert(c.begin(), -selectors[i - 1]);
+		clause(c);
+	}
+}
+
+/* --wcnf: the target hash bits are soft unit clauses, so that a MaxSAT
+ * solver finds a message that matches as many of them as it can */
+struct soft_clause {
+	int literal;
+	unsigned long weight;
+};
+
+static std::vector<soft_clause> soft_clauses;
+
+static void soft_bit(int x[32], unsigned int bit, bool value, unsigned long weight)
+{
+	soft_clauses.push_back(soft_clause{value ? x[bit] : -x[bit], weight});
+}
+
+/* e implies x[bit] = y[bit], and e is soft */
+static void soft_equal_bit(std::string name, int x[32], int y[32], unsigned int bit, unsigned long weight)
+{
+	component_scope scope("target");
+
+	int e[1];
+	new_vars(format("$_equal[$]", name, bit), e, 1, ROLE_TEMPORARY, false);
+
+	if (config_circuit)
+		gates.define(GATE_XOR, e[0], {x[bit], -y[bit]});
+
+	clause(-e[0], -x[bit], y[bit]);
+	clause(-e[0], x[bit], -y[bit]);
+
+	soft_clauses.push_back(soft_clause{e[0], weight});
+}
+
+static void preimage()
+{
+	/* Generate a known-valid (message, hash)-pair */
+	uint32_t w[16];
+	for (unsigned int i = 0; i < 16; ++i)
+		w[i] = lrand48();
+
+	sha1 f(config_nr_rounds, "", w);
+
+	trace_span span("target_constraints");
+
+	uint32_t h[5];
+	sha1_forward(config_nr_rounds, w, h);
+
+	/* Fix message bits */
+	comment(format("Fix $ message bits", config_nr_message_bits));
+
+	std::vector<unsigned int> message_bits(512);
+	for (unsigned int i = 0; i < 512; ++i)
+		message_bits[i] = i;
+
+	std::random_shuffle(message_bits.begin(), message_bits.end());
+	for (unsigned int i = 0; i < config_nr_message_bits; ++i) {
+		unsigned int r = message_bits[i] / 32;
+		unsigned int s = message_bits[i] % 32;
+
+		fix_bit(format("w$[$]", f.name, r), f.w[r], s, (w[r] >> s) & 1);
+	}
+
+	std::vector<unsigned int> hash_bits(160);
+	for (unsigned int i = 0; i < 160; ++i)
+		hash_bits[i] = i;
+
+	std::random_shuffle(hash_bits.begin(), hash_bits.end());
+
+	if (!targets.empty()) {
+		hash_bits.resize(config_nr_hash_bits);
+		match_targets(f, hash_bits);
+		return;
+	}
+
+	/* Fix hash bits */
+	comment(format("Fix $ hash bits", config_nr_hash_bits));
+
+	for (unsigned int i = 0; i < config_nr_hash_bits; ++i) {
+		unsigned int r = hash_bits[i] / 32;
+		unsigned int s = hash_bits[i] % 32;
+
+		if (config_wcnf)
+			soft_bit(f.h_out[r], s, (h[r] >> s) & 1, soft_weights[r]);
+		else
+			fix_bit(format("h$_out$", f.name, r), f.h_out[r], s, (h[r] >> s) & 1);
+	}
+}
+
+/* The second preimage differs from the first preimage by flipping one of
+ * the message bits. */
+static void second_preimage()
+{
+	/* Generate a known-valid (message, hash)-pair */
+	uint32_t w[16];
+	for (unsigned int i = 0; i < 16; ++i)
+		w[i] = lrand48();
+
+	sha1 f(config_nr_rounds, "", w);
+
+	trace_span span("target_constraints");
+
+	uint32_t h[5];
+	sha1_forward(config_nr_rounds, w, h);
+
+	/* Fix message bits */
+	comment(format("Fix $ message bits", config_nr_message_bits));
+
+	std::vector<unsigned int> message_bits(512);
+	for (unsigned int i = 0; i < 512; ++i)
+		message_bits[i] = i;
+
+	std::random_shuffle(message_bits.begin(), message_bits.end());
+
+	/* Flip the first bit */
+	if (config_nr_message_bits > 0) {
+		unsigned int r = message_bits[0] / 32;
+		unsigned int s = message_bits[0] % 32;
+
+		fix_bit(format("w$[$]", f.name, r), f.w[r], s, !((w[r] >> s) & 1));
+	}
+
+	for (unsigned int i = 1; i < config_nr_message_bits; ++i) {
+		unsigned int r = message_bits[i] / 32;
+		unsigned int s = message_bits[i] % 32;
+
+		fix_bit(format("w$[$]", f.name, r), f.w[r], s, (w[r] >> s) & 1);
+	}
+
+	/* Fix hash bits */
+	comment(format("Fix $ hash bits", config_nr_hash_bits));
+
+	std::vector<unsigned int> hash_bits(160);
+	for (unsigned int i = 0; i < 160; ++i)
+		hash_bits[i] = i;
+
+	std::random_shuffle(hash_bits.begin(), hash_bits.end());
+	for (unsigned int i = 0; i < config_nr_hash_bits; ++i) {
+		unsigned int r = hash_bits[i] / 32;
+		unsigned int s = hash_bits[i] % 32;
+
+		if (config_wcnf)
+			soft_bit(f.h_out[r], s, (h[r] >> s) & 1, soft_weights[r]);
+		else
+			fix_bit(format("h$_out$", f.name, r), f.h_out[r], s, (h[r] >> s) & 1);
+	}
+}
+
+static void collision()
+{
+	sha1 f(config_nr_rounds, "0");
+	sha1 g(config_nr_rounds, "1");
+
+	trace_span span("target_constraints");
+
+	if (config_nr_message_bits > 0)
+		std::cerr << "warning: collision attacks do not use fixed message bits\n";
+
+	/* Fix message bits (set m != m') */
+	comment(format("Fix $ message bits", config_nr_message_bits));
+
+	std::vector<unsigned int> message_bits(512);
+	for (unsigned int i = 0; i < 512; ++i)
+		message_bits[i] = i;
 
 	std::random_shuffle(message_bits.begin(), message_bits.end());
 
-	/* Flip the first bit */
-	if (config_nr_message_bits > 0) {
-		unsigned int r = message_bits[0] / 32;
-		unsigned int s = message_bits[0] % 32;
+	/* Flip some random bit */
+	{
+		unsigned int r = message_bits[0] / 32;
+		unsigned int s = message_bits[0] % 32;
+
+		differ_bit(format("w$[$]", f.name, r), f.w[r], format("w$[$]", g.name, r), g.w[r], s);
+	}
+
+	/* Fix hash bits (set H = H') */
+	comment(format("Fix $ hash bits", config_nr_hash_bits));
+
+	std::vector<unsigned int> hash_bits(160);
+	for (unsigned int i = 0; i < 160; ++i)
+		hash_bits[i] = i;
+
+	std::random_shuffle(hash_bits.begin(), hash_bits.end());
+	for (unsigned int i = 0; i < config_nr_hash_bits; ++i) {
+		unsigned int r = hash_bits[i] / 32;
+		unsigned int s = hash_bits[i] % 32;
+
+		if (config_wcnf)
+			soft_equal_bit(format("h$_out$", f.name, r), f.h_out[r], g.h_out[r], s, soft_weights[r]);
+		else
+			equal_bit(format("h$_out$", f.name, r), f.h_out[r], format("h$_out$", g.name, r), g.h_out[r], s);
+	}
+}
+
+/* Write the symbol table as JSON, one symbol per line, so that tools can
+ * find variables without scanning the instance for "var" comments. */
+static void write_map(const std::string &filename, unsigned long seed)
+{
+	trace_span span("write_map");
+
+	std::ofstream out(filename.c_str());
+	if (!out)
+		throw std::runtime_error("could not open symbol map");
+
+	out << "{\n";
+	out << "\t\"version\": 1,\n";
+	out << format("\t\"attack\": \"$\",\n", config_attack);
+	out << format("\t\"nr_rounds\": $,\n", config_nr_rounds);
+	out << format("\t\"seed\": $,\n", seed);
+	out << format("\t\"nr_variables\": $,\n", nr_variables);
+	out << "\t\"symbols\": [\n";
+
+	for (unsigned int i = 0; i < var_labels.size(); ++i) {
+		const var_label &l = var_labels[i];
+
+		/* The bits whose values in a solution mean nothing */
+		std::string removed;
+		for (unsigned int j = 0; j < l.width; ++j) {
+			if (l.first + j < removed_variables.size() && removed_variables[l.first + j])
+				removed += format("$$", removed.empty() ? "" : ", ", j);
+		}
+
+		out << format("\t\t{\"name\": \"$\", \"first\": $, \"width\": $, \"role\": \"$\"$}$\n",
+			l.name, l.first, l.width, var_role_names[l.role],
+			removed.empty() ? "" : format(", \"removed\": [$]", removed),
+			i + 1 < var_labels.size() ? "," : "");
+	}
+
+	out << "\t],\n";
+	out << "\t\"constraints\": [\n";
+
+	for (unsigned int i = 0; i < target_constraints.size(); ++i) {
+		const target_constraint &c = target_constraints[i];
+		const char *sep = i + 1 < target_constraints.size() || !targets.empty() ? "," : "";
+
+		if (c.other.empty()) {
+			out << format("\t\t{\"type\": \"$\", \"name\": \"$\", \"bit\": $, \"value\": $}$\n",
+				c.type, c.name, c.bit, c.value ? 1 : 0, sep);
+		} else {
+			out << format("\t\t{\"type\": \"$\", \"name\": \"$\", \"other\": \"$\", \"bit\": $}$\n",
+				c.type, c.name, c.other, c.bit, sep);
+		}
+	}
+
+	/* --targets: the hash bits equal those of one of the hashes */
+	if (!targets.empty()) {
+		out << format("\t\t{\"type\": \"one_of\", \"name\": \"$\", \"bits\": [$], \"hashes\": [$]}\n",
+			target_hash_name, target_bits_list(), target_hashes_list("\""));
+	}
+
+	out << "\t]\n";
+	out << "}\n";
+
+	if (!out)
+		throw std::runtime_error("could not write symbol map");
+}
+
+/* The lines of the CNF and OPB text, counted the way
+ * check_planted_model() reads them, and the highest variable used */
+struct emitted_counts {
+	unsigned long nr_clauses;
+	unsigned long nr_xor_clauses;
+	unsigned long nr_halfadders;
+	unsigned long nr_pb_constraints;
+	long max_variable;
+};
+
+static emitted_counts count_emitted()
+{
+	emitted_counts r = emitted_counts();
+
+	/* Every number on a CNF line is a literal; in OPB only those after
+	 * an x are */
+	auto scan = [&r](const char *q, const char *eol, bool opb) {
+		while (q < eol) {
+			if (*q >= '0' && *q <= '9' && (!opb || q[-1] == 'x')) {
+				char *end;
+				r.max_variable = std::max(r.max_variable, strtol(q, &end, 10));
+				q = end;
+			} else {
+				++q;
+			}
+		}
+	};
+
+	if (config_cnf) {
+		std::string text = cnf.str();
+		for (const char *p = text.c_str(); *p; ) {
+			const char *line = p;
+			const char *eol = strchr(p, '\n');
+			p = eol + 1;
+
+			if (*line == 'c' || *line == 'd')
+				continue;
+
+			if (*line == 'x')
+				++r.nr_xor_clauses;
+			else if (*line == 'h')
+				++r.nr_halfadders;
+			else
+				++r.nr_clauses;
+
+			scan(line, eol, false);
+		}
+	}
+
+	if (config_opb) {
+		std::string text = opb.str();
+		for (const char *p = text.c_str(); *p; ) {
+			const char *line = p;
+			const char *eol = strchr(p, '\n');
+			p = eol + 1;
+
+			if (*line == '*')
+				continue;
+
+			++r.nr_pb_constraints;
+			scan(line, eol, true);
+		}
+	}
+
+	return r;
+}
+
+/* The sum of the components */
+static component_stats total_stats()
+{
+	component_stats total = component_stats();
+	for (const auto &it: components) {
+		const component_stats &c = it.second;
+
+		total.nr_variables += c.nr_variables;
+		total.nr_clauses += c.nr_clauses;
+		total.nr_literals += c.nr_literals;
+		total.nr_xor_clauses += c.nr_xor_clauses;
+		total.nr_xor_literals += c.nr_xor_literals;
+		total.nr_halfadders += c.nr_halfadders;
+		total.nr_pb_constraints += c.nr_pb_constraints;
+	}
+
+	return total;
+}
+
+/* Write the per-component sizes and structural features of the instance
+ * as JSON. The header counts are checked against the lines of the
+ * instance text; the features only cover the CNF clauses (not XOR or
+ * half-adder lines). */
+static void write_stats()
+{
+	trace_span span("write_stats");
+
+	std::ofstream out(config_stats.c_str());
+	if (!out)
+		throw std::runtime_error("could not open statistics file");
+
+	component_stats total = total_stats();
+
+	out << "{\n";
+	out << format("\t\"attack\": \"$\",\n", config_attack);
+	out << format("\t\"nr_rounds\": $,\n", config_nr_rounds);
+	out << format("\t\"header\": {\"variables\": $, \"clauses\": $, \"constraints\": $},\n",
+		nr_variables, nr_clauses, nr_constraints);
+
+	/* Without CNF or OPB text there is nothing to compare the header
+	 * with */
+	if (config_cnf || config_opb) {
+		emitted_counts e = count_emitted();
+
+		bool consistent = e.max_variable <= nr_variables
+			&& (!config_cnf || (e.nr_clauses == nr_clauses && e.nr_xor_clauses == nr_xor_clauses))
+			&& (!config_opb || e.nr_pb_constraints == nr_constraints);
+		if (!consistent)
+			std::cerr << "warning: header counts do not match the emitted instance\n";
+
+		out << format("\t\"emitted\": {\"max_variable\": $, \"clauses\": $, \"xor_clauses\": $, \"halfadders\": $, \"pb_constraints\": $},\n",
+			e.max_variable, e.nr_clauses, e.nr_xor_clauses, e.nr_halfadders, e.nr_pb_constraints);
+		out << format("\t\"consistent\": $,\n", consistent ? "true" : "false");
+	}
+
+	out << "\t\"components\": [\n";
+	std::vector<std::string> names;
+	for (const std::string &name: component_order) {
+		const component_stats &c = components[name];
+		if (c.nr_variables || c.nr_clauses || c.nr_xor_clauses || c.nr_halfadders || c.nr_pb_constraints)
+			names.push_back(name);
+	}
+
+	for (unsigned int i = 0; i < names.size(); ++i) {
+		const component_stats &c = components[names[i]];
+
+		out << format("\t\t{\"name\": \"$\", \"variables\": $, \"clauses\": $, \"literals\": $, \"xor_clauses\": $, \"xor_literals\": $, \"halfadders\": $, \"pb_constraints\": $}$\n",
+			names[i], c.nr_variables, c.nr_clauses, c.nr_literals, c.nr_xor_clauses,
+			c.nr_xor_literals, c.nr_halfadders, c.nr_pb_constraints,
+			i + 1 < names.size() ? "," : "");
+	}
+
+	out << "\t],\n";
+
+	out << "\t\"clause_lengths\": {";
+	bool first = true;
+	for (unsigned int i = 0; i < clause_lengths.size(); ++i) {
+		if (!clause_lengths[i])
+			continue;
+
+		out << format("$\"$\": $", first ? "" : ", ", i, clause_lengths[i]);
+		first = false;
+	}
+	out << "},\n";
+
+	unsigned long nr_cnf_clauses = std::max(total.nr_clauses, 1UL);
+	out << format("\t\"mean_clause_length\": $,\n", (double) total.nr_literals / nr_cnf_clauses);
+	out << format("\t\"unit_ratio\": $,\n",
+		(double) (clause_lengths.size() > 1 ? clause_lengths[1] : 0) / nr_cnf_clauses);
+	out << format("\t\"binary_ratio\": $,\n",
+		(double) (clause_lengths.size() > 2 ? clause_lengths[2] : 0) / nr_cnf_clauses);
+	out << format("\t\"ternary_ratio\": $,\n",
+		(double) (clause_lengths.size() > 3 ? clause_lengths[3] : 0) / nr_cnf_clauses);
+	out << format("\t\"clause_variable_ratio\": $,\n", (double) total.nr_clauses / std::max(nr_variables, 1));
+
+	/* Occurrences per variable, in power-of-two buckets */
+	unsigned int min_occurrences = ~0U;
+	unsigned int max_occurrences = 0;
+	double sum = 0;
+	double sum_squares = 0;
+	std::vector<unsigned long> buckets;
+	for (int i = 1; i <= nr_variables; ++i) {
+		unsigned int n = var_occurrences[i];
+
+		min_occurrences = std::min(min_occurrences, n);
+		max_occurrences = std::max(max_occurrences, n);
+		sum += n;
+		sum_squares += (double) n * n;
+
+		unsigned int bucket = n ? 32 - __builtin_clz(n) : 0;
+		if (buckets.size() <= bucket)
+			buckets.resize(bucket + 1);
+		++buckets[bucket];
+	}
+
+	double mean = nr_variables ? sum / nr_variables : 0;
+	double variance = nr_variables ? sum_squares / nr_variables - mean * mean : 0;
+
+	out << format("\t\"variable_occurrences\": {\"min\": $, \"max\": $, \"mean\": $, \"stddev\": $, \"histogram\": {",
+		nr_variables ? min_occurrences : 0, max_occurrences, mean, sqrt(std::max(variance, 0.0)));
+	for (unsigned int i = 0; i < buckets.size(); ++i) {
+		if (i <= 1)
+			out << format("$\"$\": $", i ? ", " : "", i, buckets[i]);
+		else
+			out << format(", \"$-$\": $", 1U << (i - 1), (1U << i) - 1, buckets[i]);
+	}
+	out << "}}\n";
+
+	out << "}\n";
+
+	if (!out)
+		throw std::runtime_error("could not write statistics file");
+}
+
+/* The options that determine the size of the instance, for predict.hh */
+static size_config prediction_config()
+{
+	size_config c;
+	c.attack = config_attack;
+	c.nr_rounds = config_nr_rounds;
+	c.nr_message_bits = config_nr_message_bits;
+	c.nr_hash_bits = config_nr_hash_bits;
+	c.cnf = config_cnf;
+	c.opb = config_opb;
+	c.comments = config_comments;
+	c.use_xor_clauses = config_use_xor_clauses;
+	c.use_halfadder_clauses = config_use_halfadder_clauses;
+	c.use_tseitin_adders = config_use_tseitin_adders;
+	c.restrict_branching = config_restrict_branching;
+	c.use_compact_adders = config_use_compact_adders;
+	return c;
+}
+
+/* --predict: the sizes from predict.hh, including the exact headers */
+static void print_prediction()
+{
+	instance_size size = predict_size(prediction_config());
+
+	std::cout << "{\n";
+	std::cout << format("\t\"nr_variables\": $,\n", size.nr_variables);
+	std::cout << format("\t\"nr_clauses\": $,\n", size.nr_clauses);
+	std::cout << format("\t\"nr_literals\": $,\n", size.nr_literals);
+	std::cout << format("\t\"nr_constraints\": $,\n", size.nr_constraints);
+	std::cout << format("\t\"nr_xor_clauses\": $,\n", size.nr_xor_clauses);
+	std::cout << format("\t\"nr_halfadders\": $,\n", size.nr_halfadders);
+	std::cout << format("\t\"nr_pb_constraints\": $,\n", size.nr_pb_constraints);
+	std::cout << format("\t\"cnf_header\": \"p cnf $ $\",\n", size.nr_variables, size.nr_clauses);
+	std::cout << format("\t\"opb_header\": \"* #variable= $ #constraint= $\",\n", size.nr_variables, size.nr_constraints);
+	std::cout << format("\t\"estimated_bytes\": $\n", size.estimated_bytes);
+	std::cout << "}\n";
+}
+
+/* With --stats or --check, compare the counts of the instance that was
+ * just generated with predict.hh, so that the model cannot drift from the
+ * encoding unnoticed. Only the options that --predict supports are
+ * checked. */
+static void check_prediction()
+{
+	if (config_aiger || config_smt2 || config_anf || config_wcnf || config_eliminate || config_probe
+		|| config_mine || config_simplify || config_plaisted_greenbaum || !config_targets.empty())
+	{
+		return;
+	}
+
+	trace_span span("check_prediction");
+
+	instance_size size = predict_size(prediction_config());
+	component_stats total = total_stats();
+
+	auto compare = [](const char *name, unsigned long predicted, unsigned long actual) {
+		if (predicted != actual)
+			throw std::runtime_error(format("predict.hh is out of date: $ is $, predicted $", name, actual, predicted));
+	};
+
+	compare("nr_variables", size.nr_variables, nr_variables);
+	compare("nr_clauses", size.nr_clauses, nr_clauses);
+	compare("nr_literals", size.nr_literals, total.nr_literals);
+	compare("nr_constraints", size.nr_constraints, nr_constraints);
+	compare("nr_xor_clauses", size.nr_xor_clauses, total.nr_xor_clauses);
+	compare("nr_xor_literals", size.nr_xor_literals, total.nr_xor_literals);
+	compare("nr_halfadders", size.nr_halfadders, total.nr_halfadders);
+	compare("nr_pb_constraints", size.nr_pb_constraints, total.nr_pb_constraints);
+}
+
+static std::string var_name(int var)
+{
+	for (const var_label &l: var_labels) {
+		if (var >= l.first && var < l.first + (int) l.width)
+			return format("$[$]", l.name, var - l.first);
+	}
+
+	return "?";
+}
+
+/* The CNF instance with every clause hard, followed by the soft clauses */
+static std::string wcnf_instance()
+{
+	trace_span span("wcnf");
+
+	unsigned long top = 1;
+	for (const soft_clause &c: soft_clauses)
+		top += c.weight;
+
+	std::ostringstream out;
+	out << format("p wcnf $ $ $\n", nr_variables, nr_clauses + soft_clauses.size(), top);
+
+	std::string text = cnf.str();
+	for (const char *p = text.c_str(); *p; ) {
+		const char *eol = strchr(p, '\n');
+
+		if (*p != 'c')
+			out << top << " ";
+		out.write(p, eol + 1 - p);
+
+		p = eol + 1;
+	}
+
+	for (const soft_clause &c: soft_clauses)
+		out << format("$ $ 0\n", c.weight, c.literal);
+
+	return out.str();
+}
+
+/* --aiger: the circuit as an and-inverter graph. The inputs are the
+ * message bits in the order of their variables (bit j of word i is input
+ * 32 * i + j, and a collision's second message follows the first) and the
+ * output is true exactly when all of the attack's constraints hold. */
+static std::string aiger_instance(const std::vector<std::string> &comments)
+{
+	trace_span span("aiger");
+
+	const std::vector<gate> &list = gates.gate_list();
+
+	std::vector<int> inputs;
+	for (const gate &g: list) {
+		if (g.type == GATE_INPUT)
+			inputs.push_back(g.outputs[0]);
+	}
+
+	aig a(inputs.size());
+	std::vector<unsigned int> lits(nr_variables + 1);
+	std::vector<std::string> names;
+	for (unsigned int i = 0; i < inputs.size(); ++i) {
+		lits[inputs[i]] = a.input(i);
+		names.push_back(var_name(inputs[i]));
+	}
+
+	auto lit = [&](int x) -> unsigned int {
+		return x < 0 ? lits[-x] ^ 1 : lits[x];
+	};
+
+	for (const gate &g: list) {
+		int r = g.outputs[0];
+
+		switch (g.type) {
+		case GATE_INPUT:
+			break;
+		case GATE_CONSTANT:
+			lits[r] = g.value;
+			break;
+		case GATE_XOR:
+			lits[r] = 0;
+			for (int x: g.inputs)
+				lits[r] = a.xor_gate(lits[r], lit(x));
+			break;
+		case GATE_AND:
+			lits[r] = 1;
+			for (int x: g.inputs)
+				lits[r] = a.and_gate(lits[r], lit(x));
+			break;
+		case GATE_OR:
+			lits[r] = 0;
+			for (int x: g.inputs)
+				lits[r] = a.or_gate(lits[r], lit(x));
+			break;
+		case GATE_CH:
+			lits[r] = a.mux(lit(g.inputs[0]), lit(g.inputs[1]), lit(g.inputs[2]));
+			break;
+		case GATE_MAJ:
+			lits[r] = a.maj(lit(g.inputs[0]), lit(g.inputs[1]), lit(g.inputs[2]));
+			break;
+		case GATE_SUM: {
+			/* Counting the inputs of each weight with half-adders */
+			unsigned int counter[8] = {};
+
+			unsigned int j = 0;
+			for (unsigned int i = 0; i < g.outputs.size(); ++i) {
+				for (; j < g.inputs.size() && g.shifts[j] == i; ++j) {
+					unsigned int carry = lit(g.inputs[j]);
+					for (unsigned int k = 0; k < 8 && carry; ++k) {
+						unsigned int t = a.and_gate(counter[k], carry);
+						counter[k] = a.xor_gate(counter[k], carry);
+						carry = t;
+					}
+				}
+
+				lits[g.outputs[i]] = counter[0];
+				for (unsigned int k = 0; k < 7; ++k)
+					counter[k] = counter[k + 1];
+				counter[7] = 0;
+			}
+			break;
+		}
+		}
+	}
+
+	unsigned int target = 1;
+	for (const target_constraint &c: target_constraints) {
+		unsigned int x = lit(c.x);
+		if (!strcmp(c.type, "fixed"))
+			target = a.and_gate(target, c.value ? x : x ^ 1);
+		else if (!strcmp(c.type, "equal"))
+			target = a.and_gate(target, a.xor_gate(x, lit(c.y)) ^ 1);
+		else
+			target = a.and_gate(target, a.xor_gate(x, lit(c.y)));
+	}
+
+	a.add_output(target, "target");
+
+	if (config_check) {
+		std::vector<bool> values;
+		for (int x: inputs)
+			values.push_back(planted_value(x));
+
+		if (!a.evaluate(values)[0])
+			throw std::runtime_error("planted model does not satisfy the AIGER output");
+	}
+
+	span.arg("ands", a.nr_ands());
+
+	std::ostringstream out;
+	a.write(out, names, comments);
+	return out.str();
+}
+
+/* --smt2: the attack at the word level. Every copy of SHA-1 is written
+ * the way the sha1 class builds it, with the same names for the message,
+ * state and hash words, and the target bits are extracted from them. */
+static std::string smt2_instance(const std::vector<std::string> &comments)
+{
+	trace_span span("smt2");
+
+	smt2 s;
+	for (const std::string &c: comments)
+		s.comment(c);
+
+	/* The planted message, with --check */
+	auto planted_word = [](const std::string &label) -> uint32_t {
+		if (!config_check)
+			return 0;
+
+		for (const var_label &l: var_labels) {
+			if (l.name != label)
+				continue;
+
+			uint32_t value = 0;
+			for (unsigned int i = 0; i < 32; ++i)
+				value |= uint32_t(planted_value(l.first + i)) << i;
+			return value;
+		}
+
+		throw std::runtime_error(format("smt2: no variables for $", label));
+	};
+
+	std::vector<std::string> names;
+	if (config_attack == "collision")
+		names = {"0", "1"};
+	else
+		names = {""};
+
+	std::map<std::string, bv_term> words;
+	std::vector<bv_term> message;
+
+	unsigned int nr_rounds = config_nr_rounds;
+	for (const std::string &name: names) {
+		s.comment(name.empty() ? "sha1" : format("sha1 $", name));
+
+		bv_term w[80];
+		for (unsigned int i = 0; i < 16; ++i) {
+			std::string label = format("w$[$]", name, i);
+			w[i] = s.declare(label, planted_word(label));
+			message.push_back(w[i]);
+			words[label] = w[i];
+		}
+
+		for (unsigned int i = 16; i < nr_rounds; ++i)
+			w[i] = s.define(format("w$[$]", name, i), s.rotate_left(1, s.bvxor({w[i - 3], w[i - 8], w[i - 14], w[i - 16]})));
+
+		bv_term k[4];
+		for (unsigned int i = 0; i < 4; ++i)
+			k[i] = s.constant(sha1_k[i]);
+
+		bv_term h_in[5];
+		for (unsigned int i = 0; i < 5; ++i)
+			h_in[i] = s.constant(sha1_iv[i]);
+
+		bv_term a[85];
+		a[4] = h_in[0];
+		a[3] = h_in[1];
+		a[2] = s.rotate_left(32 - 30, h_in[2]);
+		a[1] = s.rotate_left(32 - 30, h_in[3]);
+		a[0] = s.rotate_left(32 - 30, h_in[4]);
+
+		for (unsigned int i = 0; i < nr_rounds; ++i) {
+			bv_term b = a[i + 3];
+			bv_term c = s.rotate_left(30, a[i + 2]);
+			bv_term d = s.rotate_left(30, a[i + 1]);
+			bv_term e = s.rotate_left(30, a[i + 0]);
+
+			/* Ch and Maj without bvor or bvnot */
+			bv_term f;
+			if (i < 20)
+				f = s.bvxor({d, s.bvand({b, s.bvxor({c, d})})});
+			else if (i >= 40 && i < 60)
+				f = s.bvxor({s.bvand({b, c}), s.bvand({b, d}), s.bvand({c, d})});
+			else
+				f = s.bvxor({b, c, d});
+
+			a[i + 5] = s.define(format("a$[$]", name, i + 5),
+				s.bvadd({s.rotate_left(5, a[i + 4]), f, e, k[i / 20], w[i]}));
+		}
+
+		bv_term h_out[5] = {
+			a[nr_rounds + 4],
+			a[nr_rounds + 3],
+			s.rotate_left(30, a[nr_rounds + 2]),
+			s.rotate_left(30, a[nr_rounds + 1]),
+			s.rotate_left(30, a[nr_rounds + 0]),
+		};
+
+		for (unsigned int i = 0; i < 5; ++i) {
+			std::string label = format("h$_out$", name, i);
+			words[label] = s.define(label, s.bvadd({h_in[i], h_out[i]}));
+		}
+	}
+
+	s.comment("target");
+	for (const target_constraint &c: target_constraints) {
+		bv_term x = s.extract(words.at(c.name), c.bit);
+		if (!strcmp(c.type, "fixed"))
+			s.assert_equal(x, s.bit(c.value));
+		else if (!strcmp(c.type, "equal"))
+			s.assert_equal(x, s.extract(words.at(c.other), c.bit));
+		else
+			s.assert_distinct(x, s.extract(words.at(c.other), c.bit));
+	}
+
+	if (config_check && !s.satisfied)
+		throw std::runtime_error("planted model does not satisfy the SMT-LIB assertions");
+
+	return s.str(message);
+}
+
+/* --anf: one polynomial per gate, r + f(inputs), over the variables of
+ * the CNF instance. Bit k of the number of ones among the inputs of a
+ * column adder is the elementary symmetric polynomial of degree 2^k in
+ * them (by Lucas' theorem), so the adder outputs, carries included, are
+ * written as e_1, e_2, e_4, ... of the column. */
+static std::string anf_instance(const std::vector<std::string> &comments)
+{
+	trace_span span("anf");
+
+	std::vector<anf_polynomial> polynomials;
+
+	for (const gate &g: gates.gate_list()) {
+		std::vector<anf_polynomial> in;
+		for (int x: g.inputs)
+			in.push_back(anf_literal(x));
+
+		anf_polynomial f;
+
+		switch (g.type) {
+		case GATE_INPUT:
+			continue;
+		case GATE_CONSTANT:
+			f = anf_constant(g.value);
+			break;
+		case GATE_XOR:
+			for (const anf_polynomial &p: in)
+				anf_add(f, p);
+			break;
+		case GATE_AND:
+			f = anf_constant(true);
+			for (const anf_polynomial &p: in)
+				f = anf_multiply(f, p);
+			break;
+		case GATE_OR:
+			/* a | b = (a + 1)(b + 1) + 1 */
+			f = anf_constant(true);
+			for (anf_polynomial p: in) {
+				anf_add(p, anf_constant(true));
+				f = anf_multiply(f, p);
+			}
+			anf_add(f, anf_constant(true));
+			break;
+		case GATE_CH:
+			/* bc + (b + 1)d */
+			f = anf_multiply(in[0], in[1]);
+			anf_add(f, anf_multiply(in[0], in[2]));
+			anf_add(f, in[2]);
+			break;
+		case GATE_MAJ:
+			f = anf_multiply(in[0], in[1]);
+			anf_add(f, anf_multiply(in[0], in[2]));
+			anf_add(f, anf_multiply(in[1], in[2]));
+			break;
+		case GATE_SUM: {
+			for (uint8_t shift: g.shifts) {
+				if (shift)
+					throw std::runtime_error("anf: only column adders are supported");
+			}
+
+			unsigned int degree = 1U << (g.outputs.size() - 1);
+
+			/* e[j] is the elementary symmetric polynomial of degree j
+			 * in the inputs seen so far */
+			std::vector<anf_polynomial> e(degree + 1);
+			e[0] = anf_constant(true);
+			for (const anf_polynomial &p: in) {
+				for (unsigned int j = degree; j > 0; --j)
+					anf_add(e[j], anf_multiply(e[j - 1], p));
+			}
+
+			for (unsigned int k = 0; k < g.outputs.size(); ++k) {
+				anf_polynomial p = anf_literal(g.outputs[k]);
+				anf_add(p, e[1U << k]);
+				polynomials.push_back(p);
+			}
+
+			continue;
+		}
+		}
+
+		anf_add(f, anf_literal(g.outputs[0]));
+		polynomials.push_back(f);
+	}
+
+	for (const target_constraint &c: target_constraints) {
+		anf_polynomial p = anf_literal(c.x);
+		if (!strcmp(c.type, "fixed")) {
+			anf_add(p, anf_constant(c.value));
+		} else {
+			anf_add(p, anf_literal(c.y));
+			anf_add(p, anf_constant(!strcmp(c.type, "differ")));
+		}
+
+		polynomials.push_back(p);
+	}
+
+	if (config_check) {
+		for (const anf_polynomial &p: polynomials) {
+			if (anf_evaluate(p, planted_value))
+				throw std::runtime_error(format("planted model does not satisfy polynomial $", anf_string(p)));
+		}
+	}
+
+	span.arg("polynomials", polynomials.size());
+
+	std::ostringstream out;
+	for (const std::string &s: comments)
+		out << format("c $\n", s);
+	if (config_comments) {
+		for (const var_label &l: var_labels)
+			out << format("c var $/$ $\n", l.first, l.width, l.name);
+	}
+
+	for (const anf_polynomial &p: polynomials) {
+		if (!p.empty())
+			out << anf_string(p) << "\n";
+	}
+
+	return out.str();
+}
+
+/* The variables that verifiers read from models (message, chaining value
+ * and hash) and those of the soft clauses and target constraints; the
+ * preprocessing passes never remove them */
+static std::vector<int> protected_variables()
+{
+	std::vector<int> r;
+	for (const var_label &l: var_labels) {
+		if (l.role == ROLE_MESSAGE || l.role == ROLE_CHAINING || l.role == ROLE_HASH) {
+			for (unsigned int i = 0; i < l.width; ++i)
+				r.push_back(l.first + i);
+		}
+	}
+
+	for (const soft_clause &c: soft_clauses)
+		r.push_back(abs(c.literal));
+
+	for (const target_constraint &c: target_constraints) {
+		r.push_back(abs(c.x));
+		if (c.y)
+			r.push_back(abs(c.y));
+	}
+
+	return r;
+}
+
+/* Take the clauses out of the arena and the CNF text (keeping the
+ * comments and "d" lines), so that a preprocessing pass can write its
+ * result with rewrite_clause() */
+static void take_clauses(std::vector<int> &literals, std::vector<uint64_t> &offsets)
+{
+	literals.clear();
+	offsets.assign(1, 0);
+	literals.swap(clause_literals);
+	offsets.swap(clause_offsets);
+
+	std::string text = cnf.str();
+	cnf.str("");
+	for (const char *p = text.c_str(); *p; ) {
+		const char *eol = strchr(p, '\n');
+		if (*p == 'c' || *p == 'd')
+			cnf.write(p, eol + 1 - p);
+		p = eol + 1;
+	}
+
+	nr_clauses = 0;
+	nr_constraints = 0;
+}
+
+static void rewrite_clause(const std::vector<int> &v)
+{
+	if (config_cnf) {
+		for (int x: v)
+			cnf << format("$$ ", x < 0 ? "-" : "", abs(x));
+		cnf << format("0\n");
+	}
+
+	clause_literals.insert(clause_literals.end(), v.begin(), v.end());
+	clause_offsets.push_back(clause_literals.size());
+
+	++nr_clauses;
+	++nr_constraints;
+}
+
+/* Whether the planted model, with the variables that a pass removed set
+ * to their wrong values and then reconstructed by extend, satisfies the
+ * clauses the pass started from */
+template<typename R, typename E>
+static bool check_extended_model(const std::vector<int> &literals, const std::vector<uint64_t> &offsets,
+	R removed, E extend, unsigned int &clause_nr)
+{
+	std::vector<bool> model(nr_variables + 1);
+	for (int i = 1; i <= nr_variables; ++i)
+		model[i] = planted_value(i) ^ removed(i);
+
+	extend(model);
+
+	for (unsigned int i = 0; i + 1 < offsets.size(); ++i) {
+		bool satisfied = false;
+		for (uint64_t j = offsets[i]; j < offsets[i + 1]; ++j)
+			satisfied = satisfied || model[abs(literals[j])] == (literals[j] > 0);
+
+		if (!satisfied) {
+			clause_nr = i + 1;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* --probe: failed-literal probing on the carry and state variables, and
+ * substitution of the equivalences it finds. The budget is counted in
+ * millions of clauses visited by unit propagation rather than time, so
+ * the same options give the same instance on every machine. */
+static void probe_variables()
+{
+	trace_span span("probe");
+
+	prober p(nr_variables);
+	for (int x: protected_variables())
+		p.protect(x);
+
+	std::vector<int> candidates;
+	for (const var_label &l: var_labels) {
+		if (l.role == ROLE_CARRY || l.role == ROLE_STATE) {
+			for (unsigned int i = 0; i < l.width; ++i)
+				candidates.push_back(l.first + i);
+		}
+	}
+
+	std::vector<int> literals;
+	std::vector<uint64_t> offsets;
+	take_clauses(literals, offsets);
+
+	for (unsigned int i = 0; i + 1 < offsets.size(); ++i)
+		p.add_clause(&literals[offsets[i]], offsets[i + 1] - offsets[i]);
+
+	p.run(candidates, (uint64_t) config_probe_budget * 1000000);
+
+	std::vector<bool> used(nr_variables + 1);
+	for (int x: literals)
+		used[abs(x)] = true;
+
+	unsigned int nr_removed = 0;
+	removed_variables.resize(nr_variables + 1);
+	for (int i = 1; i <= nr_variables; ++i) {
+		nr_removed += used[i] && p.removed(i);
+		if (p.removed(i))
+			removed_variables[i] = true;
+	}
+
+	unsigned int nr_original_clauses = offsets.size() - 1;
+	p.for_each_clause(rewrite_clause);
+
+	comment(format("probe: $ of $ variables probed, $ failed literals, $ units, $ equivalences; $ variables removed, $ -> $ clauses",
+		p.nr_probed, candidates.size(), p.nr_failed, p.nr_units, p.nr_equivalences,
+		nr_removed, nr_original_clauses, nr_clauses));
+
+	span.arg("probed", p.nr_probed);
+	span.arg("failed", p.nr_failed);
+	span.arg("units", p.nr_units);
+	span.arg("equivalences", p.nr_equivalences);
+	span.arg("removed", nr_removed);
+
+	if (config_check) {
+		unsigned int clause_nr;
+		if (!check_extended_model(literals, offsets,
+			[&](int x) { return p.removed(x); },
+			[&](std::vector<bool> &model) { p.extend(model); }, clause_nr))
+		{
+			throw std::runtime_error(format("probe: the extended model violates clause $", clause_nr));
+		}
+	}
+}
+
+/* --eliminate: preprocess the clauses in the arena and write the result
+ * instead of the clauses */
+static void eliminate_variables()
+{
+	trace_span span("eliminate");
+
+	eliminator e(nr_variables);
+	for (int x: protected_variables())
+		e.protect(x);
+
+	std::vector<int> literals;
+	std::vector<uint64_t> offsets;
+	take_clauses(literals, offsets);
+
+	for (unsigned int i = 0; i + 1 < offsets.size(); ++i)
+		e.add_clause(&literals[offsets[i]], offsets[i + 1] - offsets[i]);
+
+	e.run(config_eliminate_growth);
+
+	removed_variables.resize(nr_variables + 1);
+	for (int i = 1; i <= nr_variables; ++i) {
+		if (e.removed(i))
+			removed_variables[i] = true;
+	}
+
+	unsigned int nr_original_clauses = offsets.size() - 1;
+	e.for_each_clause(rewrite_clause);
+
+	comment(format("eliminate: $ variables eliminated, $ clauses subsumed, $ literals removed by self-subsumption, $ -> $ clauses",
+		e.nr_eliminated, e.nr_subsumed, e.nr_strengthened, nr_original_clauses, nr_clauses));
+
+	span.arg("eliminated", e.nr_eliminated);
+	span.arg("subsumed", e.nr_subsumed);
+	span.arg("strengthened", e.nr_strengthened);
+
+	if (config_check) {
+		unsigned int clause_nr;
+		if (!check_extended_model(literals, offsets,
+			[&](int x) { return e.removed(x); },
+			[&](std::vector<bool> &model) { e.extend(model); }, clause_nr))
+		{
+			throw std::runtime_error(format("eliminate: the extended model violates clause $", clause_nr));
+		}
+	}
+
+	if (!config_elimination_stack.empty()) {
+		std::ofstream out(config_elimination_stack.c_str());
+		if (!out)
+			throw std::runtime_error("could not open elimination stack");
+
+		out << "c Clauses of the eliminated variables. To extend a model of the instance,\n";
+		out << "c go through them from the last to the first and make the first literal\n";
+		out << "c of every clause that is false true.\n";
+		for (const std::vector<int> &c: e.elimination_stack()) {
+			for (int x: c)
+				out << x << " ";
+			out << "0\n";
+		}
+
+		if (!out)
+			throw std::runtime_error("could not write elimination stack");
+	}
+}
+
+/* Write the deferred gate clauses that are needed. Gates are visited from
+ * the outputs back towards the message, so that every use of a gate's
+ * output has been seen before its clauses are looked at. */
+static void write_gate_clauses()
+{
+	trace_span span("plaisted_greenbaum");
+
+	/* The hash words are read back from solutions (verify-preimage
+	 * recomputes and compares them), so they must have their values */
+	for (const var_label &l: var_labels) {
+		if (l.role == ROLE_HASH) {
+			for (unsigned int i = 0; i < l.width; ++i)
+				occurs(l.first + i, 3);
+		}
+	}
+
+	std::vector<unsigned int> order(deferred_clauses.size());
+	for (unsigned int i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	std::stable_sort(order.begin(), order.end(), [](unsigned int i, unsigned int j) {
+		return gates.gate_number(deferred_clauses[i].r) > gates.gate_number(deferred_clauses[j].r);
+	});
+
+	component_stats *saved = current_component;
+	unsigned long nr_dropped = 0;
+
+	for (unsigned int i = 0; i < order.size(); ) {
+		/* Writing the clauses of r adds to the polarities of r itself */
+		int r = deferred_clauses[order[i]].r;
+		uint8_t polarity = polarities[r];
+
+		for (; i < order.size() && deferred_clauses[order[i]].r == r; ++i) {
+			const deferred_clause &c = deferred_clauses[order[i]];
+			bool negative = std::find(c.literals.begin(), c.literals.end(), -r) != c.literals.end();
+
+			if (!(polarity & (negative ? 1 : 2))) {
+				++nr_dropped;
+				continue;
+			}
+
+			current_component = c.component;
+			clause(c.literals);
+		}
+	}
+
+	current_component = saved;
+	comment(format("plaisted-greenbaum: $ of $ gate clauses dropped", nr_dropped, deferred_clauses.size()));
+
+	span.arg("clauses", deferred_clauses.size());
+	span.arg("dropped", nr_dropped);
+	deferred_clauses.clear();
+}
+
+/* Lemmas about the circuit, which hold whatever the target is */
+static void mine_lemmas()
+{
+	trace_span span("mine_lemmas");
+	component_scope scope("lemmas");
+
+	circuit_lemmas lemmas = circuit_lemmas();
+	gates.mine(config_mine, lemmas);
+
+	comment(format("$ lemmas from $ simulations ($ candidates): $ constants, $ equivalences, $ binary clauses",
+		lemmas.units.size() + lemmas.equivalences.size() + lemmas.implications.size(), 64 * config_mine,
+		lemmas.nr_candidates, lemmas.units.size(), lemmas.equivalences.size(), lemmas.implications.size()));
+
+	for (int x: lemmas.units)
+		clause(x);
+
+	for (auto &it: lemmas.equivalences)
+		eq(&it.first, &it.second, 1);
 
-		constant(f.w[r][s], !((w[r] >> s) & 1));
+	for (auto &it: lemmas.implications)
+		clause(it.first, it.second);
+
+	span.arg("candidates", lemmas.nr_candidates);
+	span.arg("units", lemmas.units.size());
+	span.arg("equivalences", lemmas.equivalences.size());
+	span.arg("implications", lemmas.implications.size());
+}
+
+/* Check the text of the instance against the planted model in one pass:
+ * every clause, XOR, half-adder and PB constraint must hold and the
+ * header counts must match what was written. The line numbers count the
+ * header line. */
+static void check_planted_model()
+{
+	trace_span span("check_planted_model");
+
+	for (int i = 1; i <= nr_variables; ++i) {
+		if (!gates.defined(i))
+			throw std::runtime_error(format("planted model: variable $ ($) is never defined", i, var_name(i)));
 	}
 
-	for (unsigned int i = 1; i < config_nr_message_bits; ++i) {
-		unsigned int r = message_bits[i] / 32;
-		unsigned int s = message_bits[i] % 32;
+	/* The next number on the line; 0 at the end of a clause */
+	auto next = [](const char *&p) -> long {
+		char *end;
+		long x = strtol(p, &end, 10);
+		p = end;
+		return x;
+	};
+
+	auto value = [](long x) -> bool {
+		if (x == 0 || labs(x) > nr_variables)
+			throw std::runtime_error(format("planted model: variable $ is out of range", labs(x)));
+
+		return planted_value(x);
+	};
+
+	if (config_cnf) {
+		std::string text = cnf.str();
+		unsigned int line_nr = 1;
+		unsigned int nr_cnf_clauses = 0;
+
+		for (const char *p = text.c_str(); *p; ) {
+			const char *line = p;
+			const char *eol = strchr(p, '\n');
+			p = eol + 1;
+			++line_nr;
+
+			if (*line == 'c' || *line == 'd')
+				continue;
+
+			const char *q = line;
+			bool ok = false;
+			if (*q == 'x') {
+				++q;
+				for (long x; (x = next(q)); )
+					ok ^= value(x);
+			} else if (*q == 'h') {
+				++q;
+
+				unsigned int sum = 0;
+				for (long x; (x = next(q)); )
+					sum += value(x);
+
+				unsigned int total = 0;
+				for (long x, i = 0; (x = next(q)); ++i)
+					total += value(x) << i;
+
+				ok = sum == total;
+			} else {
+				++nr_cnf_clauses;
+				for (long x; (x = next(q)); )
+					ok |= value(x);
+			}
+
+			if (!ok) {
+				throw std::runtime_error(format("planted model violates CNF line $: $",
+					line_nr, std::string(line, eol)));
+			}
+		}
 
-		constant(f.w[r][s], (w[r] >> s) & 1);
+		if (nr_cnf_clauses != nr_clauses)
+			throw std::runtime_error(format("CNF header says $ clauses, but there are $", nr_clauses, nr_cnf_clauses));
+
+		for (const soft_clause &c: soft_clauses) {
+			if (!value(c.literal))
+				throw std::runtime_error(format("planted model violates soft clause $", c.literal));
+		}
 	}
 
-	/* Fix hash bits */
-	comment(format("Fix $ hash bits", config_nr_hash_bits));
+	if (config_opb) {
+		std::string text = opb.str();
+		unsigned int line_nr = 1;
+		unsigned int nr_opb_constraints = 0;
+
+		for (const char *p = text.c_str(); *p; ) {
+			const char *line = p;
+			const char *eol = strchr(p, '\n');
+			p = eol + 1;
+			++line_nr;
+
+			if (*line == '*')
+				continue;
+
+			++nr_opb_constraints;
+
+			/* Terms are "<coefficient> x<n>" or "<coefficient> ~x<n>",
+			 * followed by ">= <n>;" or "= <n>;" */
+			int64_t lhs = 0;
+			const char *q = line;
+			while (true) {
+				while (*q == ' ')
+					++q;
+				if (*q == '>' || *q == '=')
+					break;
 
-	std::vector<unsigned int> hash_bits(160);
-	for (unsigned int i = 0; i < 160; ++i)
-		hash_bits[i] = i;
+				char *end;
+				int64_t coefficient = strtoll(q, &end, 10);
+				q = end + 1;
 
-	std::random_shuffle(hash_bits.begin(), hash_bits.end());
-	for (unsigned int i = 0; i < config_nr_hash_bits; ++i) {
-		unsigned int r = hash_bits[i] / 32;
-		unsigned int s = hash_bits[i] % 32;
+				bool negated = *q == '~';
+				q += negated ? 2 : 1;
+
+				lhs += coefficient * (value(next(q)) ^ negated);
+			}
+
+			bool at_least = *q == '>';
+			q += at_least ? 2 : 1;
+			int64_t rhs = strtoll(q, 0, 10);
 
-		constant(f.h_out[r][s], (h[r] >> s) & 1);
+			if (at_least ? lhs < rhs : lhs != rhs) {
+				throw std::runtime_error(format("planted model violates OPB line $: $",
+					line_nr, std::string(line, eol)));
+			}
+		}
+
+		if (nr_opb_constraints != nr_constraints)
+			throw std::runtime_error(format("OPB header says $ constraints, but there are $", nr_constraints, nr_opb_constraints));
 	}
 }
 
-static void collision()
+/* In the format solvers print, so that the verifiers can read it */
+static void write_planted_model()
 {
-	sha1 f(config_nr_rounds, "0");
-	sha1 g(config_nr_rounds, "1");
-
-	if (config_nr_message_bits > 0)
-		std::cerr << "warning: collision attacks do not use fixed message bits\n";
+	std::ofstream out(config_planted.c_str());
+	if (!out)
+		throw std::runtime_error("could not open planted model file");
+
+	out << "s SATISFIABLE\n";
+	for (int i = 1; i <= nr_variables; ++i) {
+		if (i % 16 == 1)
+			out << "v";
+		out << format(" $$", planted_value(i) ? "" : "-", i);
+		if (i % 16 == 0 || i == nr_variables)
+			out << "\n";
+	}
+	out << "v 0\n";
 
-	/* Fix message bits (set m != m') */
-	comment(format("Fix $ message bits", config_nr_message_bits));
+	if (!out)
+		throw std::runtime_error("could not write planted model file");
+}
 
-	std::vector<unsigned int> message_bits(512);
-	for (unsigned int i = 0; i < 512; ++i)
-		message_bits[i] = i;
+/* Everything that determines the instance (and its map), for --cache;
+ * the command line is not included since option order and spelling do
+ * not matter */
+static std::string cache_options(unsigned long seed)
+{
+	std::string target_list;
+	for (const hash_target &t: targets) {
+		for (unsigned int i = 0; i < 5; ++i)
+			target_list += format("$", t.h[i]) + (i < 4 ? ":" : ",");
+	}
 
-	std::random_shuffle(message_bits.begin(), message_bits.end());
+	return format("attack=$ rounds=$ message-bits=$ hash-bits=$ seed=$ cnf=$ opb=$ aiger=$ smt2=$ anf=$ wcnf=$ soft-weights=$ comments=$ xor=$ halfadder=$ tseitin-adders=$ restrict-branching=$ compact-adders=$ mine=$ simplify=$ plaisted-greenbaum=$ targets=$ eliminate=$ eliminate-growth=$ probe=$ probe-budget=$",
+		config_attack, config_nr_rounds, config_nr_message_bits, config_nr_hash_bits, seed,
+		config_cnf, config_opb, config_aiger, config_smt2, config_anf, config_wcnf, config_soft_weights, config_comments, config_use_xor_clauses, config_use_halfadder_clauses,
+		config_use_tseitin_adders, config_restrict_branching, config_use_compact_adders, config_mine, config_simplify,
+		config_plaisted_greenbaum, target_list, config_eliminate, config_eliminate_growth,
+		config_probe, config_probe_budget);
+}
 
-	/* Flip some random bit */
-	{
-		unsigned int r = message_bits[0] / 32;
-		unsigned int s = message_bits[0] % 32;
+/* Resources used to generate the instance, as JSON; used by bench */
+static void write_usage_report(double seconds)
+{
+	std::ofstream out(config_usage_report.c_str());
+	if (!out)
+		throw std::runtime_error("could not open usage report");
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	out << "{\n";
+	out << format("\t\"seconds\": $,\n", seconds);
+	out << format("\t\"allocations\": $,\n", nr_allocations);
+	out << format("\t\"allocated_bytes\": $,\n", nr_allocated_bytes);
+	out << format("\t\"max_rss_kb\": $,\n", usage.ru_maxrss);
+	out << format("\t\"nr_variables\": $,\n", nr_variables);
+	out << format("\t\"nr_clauses\": $,\n", nr_clauses);
+	out << format("\t\"nr_constraints\": $\n", nr_constraints);
+	out << "}\n";
+
+	if (!out)
+		throw std::runtime_error("could not write usage report");
+}
 
-		neq(&f.w[r][s], &g.w[r][s], 1);
+/* Lay out the clause arena (see arena.hh) in a sealed memfd, then run
+ * the solver with the descriptor inherited and its number in SHA1_SAT_FD.
+ * Returns the solver's exit status. */
+static int run_shm_solver()
+{
+	uint64_t nr_arena_clauses = clause_offsets.size() - 1;
+
+	uint64_t strings_size = 0;
+	for (const var_label &l: var_labels)
+		strings_size += l.name.size() + 1;
+
+	arena_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, ARENA_MAGIC, sizeof(ARENA_MAGIC));
+	h.version = ARENA_VERSION;
+	h.header_size = sizeof(h);
+	h.nr_variables = nr_variables;
+	h.nr_clauses = nr_arena_clauses;
+	h.nr_literals = clause_literals.size();
+	h.nr_labels = var_labels.size();
+	h.offsets_offset = sizeof(h);
+	h.literals_offset = h.offsets_offset + sizeof(uint64_t) * clause_offsets.size();
+	h.labels_offset = h.literals_offset + sizeof(int32_t) * clause_literals.size();
+	h.labels_offset = (h.labels_offset + 7) & ~7UL;
+	h.strings_offset = h.labels_offset + sizeof(arena_label) * var_labels.size();
+	h.size = h.strings_offset + strings_size;
+
+	int fd = memfd_create("sha1-sat", MFD_ALLOW_SEALING);
+	if (fd == -1)
+		throw std::runtime_error("memfd_create() failed");
+
+	if (ftruncate(fd, h.size) == -1)
+		throw std::runtime_error("ftruncate() failed");
+
+	char *p = (char *) mmap(NULL, h.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		throw std::runtime_error("mmap() failed");
+
+	memcpy(p, &h, sizeof(h));
+	memcpy(p + h.offsets_offset, &clause_offsets[0], sizeof(uint64_t) * clause_offsets.size());
+	memcpy(p + h.literals_offset, &clause_literals[0], sizeof(int32_t) * clause_literals.size());
+
+	arena_label *labels = (arena_label *) (p + h.labels_offset);
+	char *strings = p + h.strings_offset;
+	uint64_t name = 0;
+	for (const var_label &l: var_labels) {
+		labels->first = l.first;
+		labels->width = l.width;
+		labels->name = name;
+		++labels;
+
+		memcpy(strings + name, l.name.c_str(), l.name.size() + 1);
+		name += l.name.size() + 1;
 	}
 
-	/* Fix hash bits (set H = H') */
-	comment(format("Fix $ hash bits", config_nr_hash_bits));
+	munmap(p, h.size);
 
-	std::vector<unsigned int> hash_bits(160);
-	for (unsigned int i = 0; i < 160; ++i)
-		hash_bits[i] = i;
+	/* The solver only ever gets to see the finished arena */
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+		throw std::runtime_error("fcntl(F_ADD_SEALS) failed");
 
-	std::random_shuffle(hash_bits.begin(), hash_bits.end());
-	for (unsigned int i = 0; i < config_nr_hash_bits; ++i) {
-		unsigned int r = hash_bits[i] / 32;
-		unsigned int s = hash_bits[i] % 32;
+	std::cout.flush();
+
+	pid_t child = fork();
+	if (child == -1)
+		throw std::runtime_error("fork() failed");
+
+	if (child == 0) {
+		setenv("SHA1_SAT_FD", format("$", fd).c_str(), 1);
+		execl("/bin/sh", "sh", "-c", config_shm_solver.c_str(), (char *) NULL);
+		perror("execl()");
+		_exit(127);
+	}
+
+	close(fd);
 
-		eq(&f.h_out[r][s], &g.h_out[r][s], 1);
+	int status;
+	while (waitpid(child, &status, 0) == -1) {
+		if (errno != EINTR)
+			throw std::runtime_error("waitpid() failed");
 	}
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+
+	return 128 + WTERMSIG(status);
 }
 
-int main(int argc, char *argv[])
+/* The whole generator; sha1-satd runs this for every request */
+static int generator_main(int argc, char *argv[])
 {
 	unsigned long seed = time(0);
 
 	/* Process command line */
 	{
+		trace_span span("parse_arguments");
+
 		using namespace boost::program_options;
 
 		options_description options("Options");
@@ -828,13 +2859,33 @@ int main(int argc, char *argv[])
 			("rounds", value<unsigned int>(&config_nr_rounds), "Number of rounds (16-80)")
 			("message-bits", value<unsigned int>(&config_nr_message_bits), "Number of fixed message bits (0-512)")
 			("hash-bits", value<unsigned int>(&config_nr_hash_bits), "Number of fixed hash bits (0-160)")
+			("targets", value<std::string>(&config_targets), "Look for a preimage of any of the hashes in this file (one per line, in hex), on the --hash-bits chosen bits")
+			("mine", value<unsigned int>(&config_mine), "Add the constants, equivalences and binary clauses that hold in this many simulations of 64 random messages and can be proven locally")
 		;
 
 		options_description format_options("Format options");
 		format_options.add_options()
 			("cnf", "Generate CNF")
 			("opb", "Generate OPB")
-			("tseitin-adders", "Use Tseitin encoding of the circuit representation of adders");
+			("aiger", "Generate binary AIGER, with the message bits as inputs and the attack's constraints as the output")
+			("smt2", "Generate SMT-LIB 2 (QF_BV), with 32-bit words")
+			("anf", "Generate polynomials over GF(2) in algebraic normal form")
+			("wcnf", "Generate weighted partial MaxSAT, with the target hash bits as soft clauses")
+			("null", "Generate the instance but do not output it (for benchmarking)")
+			("predict", "Print the size of the instance as JSON instead of generating it")
+			("map", value<std::string>(&config_map), "Write a JSON symbol map of the instance variables to this file")
+			("stats", value<std::string>(&config_stats), "Write per-component sizes and structural features as JSON to this file")
+			("no-comments", "Do not include comments in the instance")
+			("usage-report", value<std::string>(&config_usage_report), "Write time, allocations and peak memory use as JSON to this file")
+			("trace", value<std::string>(&config_trace), "Write the time spent in each phase as a Chrome trace to this file, and a summary to standard error")
+			("check", "Check the instance against the solution it was built around (preimage attacks)")
+			("planted", value<std::string>(&config_planted), "Write the solution the instance was built around to this file (preimage attacks)")
+			("cache", value<std::string>(&config_cache), "Serve instances from (and add them to) this cache directory")
+			("cache-size", value<unsigned long>(&config_cache_size), "Size budget of the cache directory in MiB")
+			("cache-compress", "Store new cache entries gzip-compressed")
+			("tseitin-adders", "Use Tseitin encoding of the circuit representation of adders")
+			("simplify", "Propagate constants and merge structurally equal gates while encoding")
+			("plaisted-greenbaum", "Only encode the directions of and/or/xor/f gates in which their outputs are used");
 		;
 
 		options_description cnf_options("CNF-specific options");
@@ -842,6 +2893,17 @@ int main(int argc, char *argv[])
 			("xor", "Use XOR clauses")
 			("halfadder", "Use half-adder clauses")
 			("restrict-branching", "Restrict branching variables to message bits")
+			("shm-solver", value<std::string>(&config_shm_solver), "Pass the clauses to this solver command in shared memory instead of printing them")
+			("eliminate", "Remove subsumed clauses and literals and eliminate variables by resolution before writing the clauses")
+			("eliminate-growth", value<unsigned int>(&config_eliminate_growth), "Number of clauses that eliminating a variable may add")
+			("elimination-stack", value<std::string>(&config_elimination_stack), "Write the clauses of the eliminated variables to this file, for extending models")
+			("probe", "Probe the carry and state variables for failed literals and equivalences and substitute them before writing the clauses")
+			("probe-budget", value<unsigned int>(&config_probe_budget), "Millions of clause visits that probing may use")
+		;
+
+		options_description wcnf_options("WCNF-specific options");
+		wcnf_options.add_options()
+			("soft-weights", value<std::string>(&config_soft_weights), "Weight of each soft hash bit, or a comma-separated weight for each of the 5 hash words")
 		;
 
 		options_description opb_options("OPB-specific options");
@@ -854,6 +2916,7 @@ int main(int argc, char *argv[])
 		all_options.add(instance_options);
 		all_options.add(format_options);
 		all_options.add(cnf_options);
+		all_options.add(wcnf_options);
 		all_options.add(opb_options);
 
 		positional_options_description p;
@@ -889,9 +2952,45 @@ int main(int argc, char *argv[])
 		if (map.count("opb"))
 			config_opb = true;
 
+		if (map.count("aiger"))
+			config_aiger = true;
+
+		if (map.count("smt2"))
+			config_smt2 = true;
+
+		if (map.count("anf"))
+			config_anf = true;
+
+		if (map.count("wcnf"))
+			config_wcnf = true;
+
+		if (map.count("null"))
+			config_null = true;
+
+		if (map.count("predict"))
+			config_predict = true;
+
+		if (!config_trace.empty())
+			trace_enabled = true;
+
+		if (map.count("check"))
+			config_check = true;
+
+		if (map.count("cache-compress"))
+			config_cache_compress = true;
+
+		if (map.count("no-comments"))
+			config_comments = false;
+
 		if (map.count("tseitin-adders"))
 			config_use_tseitin_adders = true;
 
+		if (map.count("simplify"))
+			config_simplify = true;
+
+		if (map.count("plaisted-greenbaum"))
+			config_plaisted_greenbaum = true;
+
 		if (map.count("xor"))
 			config_use_xor_clauses = true;
 
@@ -903,28 +3002,253 @@ int main(int argc, char *argv[])
 
 		if (map.count("compact-adders"))
 			config_use_compact_adders = true;
+
+		if (map.count("eliminate"))
+			config_eliminate = true;
+
+		if (map.count("probe"))
+			config_probe = true;
+	}
+
+	if (!config_cnf && !config_opb && !config_aiger && !config_smt2 && !config_anf && !config_wcnf && !config_null) {
+		std::cerr << "Must specify either --cnf, --opb, --aiger, --smt2, --anf, --wcnf or --null\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config_wcnf) {
+		if (config_cnf || config_opb || config_aiger || config_smt2 || config_anf || config_null) {
+			std::cerr << "Cannot specify --wcnf with --cnf, --opb, --aiger, --smt2, --anf or --null\n";
+			return EXIT_FAILURE;
+		}
+
+		if (config_use_xor_clauses || config_use_halfadder_clauses || config_restrict_branching || !config_shm_solver.empty()) {
+			std::cerr << "Cannot specify --wcnf with --xor, --halfadder, --restrict-branching or --shm-solver\n";
+			return EXIT_FAILURE;
+		}
+
+		/* The hard clauses are the CNF instance */
+		config_cnf = true;
+	}
+
+	if (!config_targets.empty()) {
+		if (config_attack != "preimage") {
+			std::cerr << "Can only specify --targets with --attack=preimage\n";
+			return EXIT_FAILURE;
+		}
+
+		/* The planted message is not a solution, and the other formats
+		 * only describe fixed bits */
+		if (config_check || !config_planted.empty() || config_aiger || config_smt2 || config_anf || config_wcnf || config_predict) {
+			std::cerr << "Cannot specify --targets with --check, --planted, --aiger, --smt2, --anf, --wcnf or --predict\n";
+			return EXIT_FAILURE;
+		}
+
+		read_targets(config_targets);
+	}
+
+	{
+		std::istringstream ss(config_soft_weights);
+		std::string x;
+		while (std::getline(ss, x, ',')) {
+			char *end;
+			errno = 0;
+			unsigned long weight = strtoul(x.c_str(), &end, 10);
+			if (x.empty() || *end || weight == 0 || errno || x[0] == '-') {
+				std::cerr << "Invalid --soft-weights\n";
+				return EXIT_FAILURE;
+			}
+
+			soft_weights.push_back(weight);
+		}
+
+		if (soft_weights.size() == 1)
+			soft_weights.resize(5, soft_weights[0]);
+		if (soft_weights.size() != 5) {
+			std::cerr << "--soft-weights takes one weight or one for each of the 5 hash words\n";
+			return EXIT_FAILURE;
+		}
+
+		/* The hard clause weight is 1 + the weights of up to 32 soft
+		 * bits per word, and MaxSAT solvers take weights below 2^63 */
+		unsigned long max_total = ((1UL << 63) - 2) / 32;
+		unsigned long total = 0;
+		for (unsigned long weight: soft_weights) {
+			if (weight > max_total - total) {
+				std::cerr << format("--soft-weights are too large (the weights of the 5 words may add up to at most $)\n", max_total);
+				return EXIT_FAILURE;
+			}
+
+			total += weight;
+		}
+	}
+
+	if (config_aiger && (config_cnf || config_opb || config_smt2 || config_anf || config_null)) {
+		std::cerr << "Cannot specify --aiger with --cnf, --opb, --smt2, --anf or --null\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config_smt2 && (config_cnf || config_opb || config_anf || config_null)) {
+		std::cerr << "Cannot specify --smt2 with --cnf, --opb, --anf or --null\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config_anf && (config_cnf || config_opb || config_null)) {
+		std::cerr << "Cannot specify --anf with --cnf, --opb or --null\n";
+		return EXIT_FAILURE;
+	}
+
+	/* These only change the clauses */
+	if ((config_aiger || config_smt2 || config_anf) && (config_mine || config_simplify || config_plaisted_greenbaum)) {
+		std::cerr << "Cannot specify --aiger, --smt2 or --anf with --mine, --simplify or --plaisted-greenbaum\n";
+		return EXIT_FAILURE;
 	}
 
-	if (!config_cnf && !config_opb) {
-		std::cerr << "Must specify either --cnf or --opb\n";
+	if (config_smt2 && config_use_tseitin_adders) {
+		std::cerr << "Cannot specify --smt2 with --tseitin-adders\n";
 		return EXIT_FAILURE;
 	}
 
-	if (config_use_xor_clauses && !config_cnf) {
+	if (config_null && (config_cnf || config_opb)) {
+		std::cerr << "Cannot specify --null with --cnf or --opb\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config_use_xor_clauses && !config_cnf && !config_null) {
 		std::cerr << "Cannot specify --xor without --cnf\n";
 		return EXIT_FAILURE;
 	}
 
-	if (config_use_halfadder_clauses && !config_cnf) {
+	if (config_use_halfadder_clauses && !config_cnf && !config_null) {
 		std::cerr << "Cannot specify --halfadder without --cnf\n";
 		return EXIT_FAILURE;
 	}
 
-	if (config_use_compact_adders && !config_opb) {
+	if (config_use_compact_adders && !config_opb && !config_null) {
 		std::cerr << "Cannot specify --compact-adders without --opb\n";
 		return EXIT_FAILURE;
 	}
 
+	if (config_eliminate || config_probe) {
+		if (!config_cnf || config_opb) {
+			std::cerr << "Cannot specify --eliminate or --probe without --cnf or --wcnf\n";
+			return EXIT_FAILURE;
+		}
+
+		/* XOR and half-adder lines are not clauses, and the statistics
+		 * describe the clauses as they were generated */
+		if (config_use_xor_clauses || config_use_halfadder_clauses || !config_stats.empty()) {
+			std::cerr << "Cannot specify --eliminate or --probe with --xor, --halfadder or --stats\n";
+			return EXIT_FAILURE;
+		}
+
+		config_arena = true;
+	}
+
+	if (!config_eliminate && !config_elimination_stack.empty()) {
+		std::cerr << "Cannot specify --elimination-stack without --eliminate\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config_untrusted_arguments && (!config_shm_solver.empty() || !config_map.empty() || !config_stats.empty()
+		|| !config_usage_report.empty() || !config_trace.empty() || !config_planted.empty() || !config_cache.empty()
+		|| !config_elimination_stack.empty()))
+	{
+		std::cerr << "Cannot specify --shm-solver, --map, --stats, --usage-report, --trace, --planted, --cache or --elimination-stack in a sha1-satd request\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!config_shm_solver.empty()) {
+		if (!config_cnf || config_opb) {
+			std::cerr << "Cannot specify --shm-solver without --cnf\n";
+			return EXIT_FAILURE;
+		}
+
+		if (config_use_xor_clauses || config_use_halfadder_clauses || config_restrict_branching) {
+			std::cerr << "Cannot specify --shm-solver with --xor, --halfadder or --restrict-branching\n";
+			return EXIT_FAILURE;
+		}
+
+		/* --check reads the instance text */
+		if (config_check) {
+			std::cerr << "Cannot specify --check with --shm-solver\n";
+			return EXIT_FAILURE;
+		}
+
+		/* The arena is the only copy of the clauses; as with --null,
+		 * no text is formatted */
+		config_cnf = false;
+		config_arena = true;
+	}
+
+	if (config_check || !config_planted.empty()) {
+		/* A second preimage is only known if no message bit is flipped */
+		if (config_attack == "collision" || (config_attack == "second-preimage" && config_nr_message_bits)) {
+			std::cerr << "Cannot specify --check or --planted without a known solution (collision attacks, or second-preimage attacks with fixed message bits)\n";
+			return EXIT_FAILURE;
+		}
+
+		if (config_check && config_null) {
+			std::cerr << "Cannot specify --check with --null\n";
+			return EXIT_FAILURE;
+		}
+
+		config_circuit = true;
+	}
+
+	if (config_mine)
+		config_circuit = true;
+
+	if (config_simplify) {
+		config_circuit = true;
+		gates.enable_simplification();
+	}
+
+	/* Gates are ordered by the circuit */
+	if (config_plaisted_greenbaum)
+		config_circuit = true;
+
+	if (config_aiger || config_anf)
+		config_circuit = true;
+
+	if (config_predict && (config_aiger || config_smt2 || config_anf || config_wcnf || config_eliminate || config_probe || config_mine || config_simplify || config_plaisted_greenbaum)) {
+		std::cerr << "Cannot specify --predict with --aiger, --smt2, --anf, --wcnf, --eliminate, --probe, --mine, --simplify or --plaisted-greenbaum\n";
+		return EXIT_FAILURE;
+	}
+
+	if (config_predict) {
+		print_prediction();
+		return 0;
+	}
+
+	/* The other outputs describe a run of the generator, so those runs
+	 * are not served from the cache */
+	if (!config_cache.empty() && (config_null || !config_shm_solver.empty()
+		|| !config_stats.empty() || !config_usage_report.empty() || config_check || !config_planted.empty()
+		|| !config_elimination_stack.empty()))
+	{
+		std::cerr << "Cannot specify --cache with --null, --shm-solver, --stats, --usage-report, --check, --planted or --elimination-stack\n";
+		return EXIT_FAILURE;
+	}
+
+	std::unique_ptr<instance_cache> cache;
+	if (!config_cache.empty()) {
+		trace_span span("cache_lookup");
+
+		cache.reset(new instance_cache(config_cache, config_cache_size << 20,
+			config_cache_compress, cache_options(seed)));
+
+		if (cache->serve(config_map)) {
+			if (!config_trace.empty()) {
+				write_trace(config_trace);
+				print_trace_summary(std::cerr);
+			}
+
+			return 0;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
 	comment("");
 	comment("Instance generated by sha1-sat");
 	comment("Written by Vegard Nossum <vegard.nossum@gmail.com>");
@@ -932,6 +3256,7 @@ int main(int argc, char *argv[])
 	comment("");
 
 	/* Include command line in instance */
+	std::string command_line;
 	{
 		std::ostringstream ss;
 
@@ -942,7 +3267,8 @@ int main(int argc, char *argv[])
 			ss << argv[i];
 		}
 
-		comment(format("command line: $", ss.str()));
+		command_line = ss.str();
+		comment(format("command line: $", command_line));
 	}
 
 	comment(format("parameter seed = $", seed));
@@ -957,17 +3283,137 @@ int main(int argc, char *argv[])
 		collision();
 	}	
 
-	if (config_cnf) {
-		std::cout
-			<< format("p cnf $ $\n", nr_variables, nr_clauses)
-			<< cnf.str();
+	comment(format("constraints $", target_constraints.size() + !targets.empty()));
+
+	if (config_check || !config_stats.empty())
+		check_prediction();
+
+	if (config_mine)
+		mine_lemmas();
+
+	if (config_plaisted_greenbaum)
+		write_gate_clauses();
+
+	if (config_probe)
+		probe_variables();
+
+	if (config_eliminate)
+		eliminate_variables();
+
+	if (config_check)
+		check_planted_model();
+
+	std::string anf;
+	if (config_anf) {
+		std::vector<std::string> comments;
+		if (config_comments) {
+			comments.push_back("Instance generated by sha1-sat");
+			comments.push_back(format("command line: $", command_line));
+			comments.push_back(format("parameter seed = $", seed));
+			comments.push_back("x(n) is variable n of the CNF instance; every polynomial is 0");
+		}
+
+		anf = anf_instance(comments);
 	}
 
-	if (config_opb) {
-		std::cout
-			<< format("* #variable= $ #constraint= $\n", nr_variables, nr_constraints)
-			<< opb.str();
+	std::string smtlib;
+	if (config_smt2) {
+		std::vector<std::string> comments;
+		if (config_comments) {
+			comments.push_back("Instance generated by sha1-sat");
+			comments.push_back(format("command line: $", command_line));
+			comments.push_back(format("parameter seed = $", seed));
+			comments.push_back(format("parameter nr_rounds = $", config_nr_rounds));
+		}
+
+		smtlib = smt2_instance(comments);
+	}
+
+	/* The AIGER comments are at the end of the file */
+	std::string aiger;
+	if (config_aiger) {
+		std::vector<std::string> comments;
+		if (config_comments) {
+			comments.push_back("Instance generated by sha1-sat");
+			comments.push_back(format("command line: $", command_line));
+			comments.push_back(format("parameter seed = $", seed));
+			comments.push_back("Input 32 * i + j is bit j of message word i; the output is the attack's target");
+		}
+
+		aiger = aiger_instance(comments);
+	}
+
+	if (!config_planted.empty())
+		write_planted_model();
+
+	/* A cache entry always has a map */
+	std::string map_filename = config_map;
+	if (cache && map_filename.empty())
+		map_filename = cache->map_temporary_file();
+
+	if (!map_filename.empty())
+		write_map(map_filename, seed);
+
+	if (!config_stats.empty())
+		write_stats();
+
+	if (!config_usage_report.empty())
+		write_usage_report(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+	int status = 0;
+
+	if (!config_shm_solver.empty()) {
+		trace_span span("shm_solver");
+		status = run_shm_solver();
+	} else {
+		trace_span span("output");
+
+		std::vector<std::string> output;
+
+		if (config_wcnf) {
+			output.push_back(wcnf_instance());
+		} else if (config_cnf) {
+			output.push_back(format("p cnf $ $\n", nr_variables, nr_clauses));
+			output.push_back(cnf.str());
+		}
+
+		if (config_opb) {
+			output.push_back(format("* #variable= $ #constraint= $\n", nr_variables, nr_constraints));
+			output.push_back(opb.str());
+		}
+
+		if (config_aiger)
+			output.push_back(aiger);
+
+		if (config_smt2)
+			output.push_back(smtlib);
+
+		if (config_anf)
+			output.push_back(anf);
+
+		for (const std::string &s: output)
+			std::cout << s;
+
+		std::cout.flush();
+
+		if (cache) {
+			trace_span span("cache_insert");
+			cache->insert(map_filename, output);
+		}
+	}
+
+	if (!config_trace.empty()) {
+		write_trace(config_trace);
+		print_trace_summary(std::cerr);
 	}
 
-	return 0;
+	return status;
+}
+
+/* microbench.cc and sha1-satd.cc include this file */
+#ifndef SHA1_SAT_NO_MAIN
+int main(int argc, char *argv[])
+{
+	return generator_main(argc, argv);
 }
+#endif
@@ -1,5 +1,11 @@
 set -e
 set -u
 
-g++ -Wall -std=c++0x -O2 -o main main.cc -lboost_program_options
+g++ -Wall -std=c++0x -O2 -o main main.cc -lboost_program_options -lz
 g++ -Wall -std=c++0x -O2 -o verify-preimage verify-preimage.cc
+g++ -Wall -std=c++0x -O2 -pthread -o verify-batch verify-batch.cc -lboost_program_options
+g++ -Wall -std=c++0x -O2 -pthread -o bruteforce bruteforce.cc -lboost_program_options
+g++ -Wall -std=c++0x -O2 -o bench bench.cc -lboost_program_options
+g++ -Wall -std=c++0x -O2 -o microbench microbench.cc -lboost_program_options -lz
+g++ -Wall -std=c++0x -O2 -pthread -o solver-bench solver-bench.cc -lboost_program_options
+g++ -Wall -std=c++0x -O2 -o sha1-satd sha1-satd.cc -lboost_program_options -lz
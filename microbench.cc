@@ -0,0 +1,390 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks for the encoding functions in main.cc.
+ *
+ * main.cc is compiled in (without its main()) so that the static
+ * functions can be called directly. Each benchmark is run once to count
+ * the clauses and literals it writes, then timed in repetitions of at
+ * least --min-time seconds each on a single pinned CPU; the median
+ * repetition is reported.
+ */
+
+#define SHA1_SAT_NO_MAIN
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include "main.cc"
+#pragma GCC diagnostic pop
+
+#include <algorithm>
+#include <functional>
+
+extern "C" {
+#include <sched.h>
+}
+
+struct microbench {
+	std::string name;
+
+	/* Set the config_* flags the benchmark needs */
+	std::function<void()> setup;
+
+	/* One call of the function being measured */
+	std::function<void()> run;
+};
+
+struct microbench_result {
+	unsigned long nr_calls;
+	double median_ns;
+	double min_ns;
+	unsigned long nr_clauses;
+	unsigned long nr_literals;
+	unsigned long nr_allocations;
+};
+
+static int vars_a[32];
+static int vars_b[32];
+static int vars_c[32];
+static int vars_d[32];
+static int vars_e[32];
+static int vars_r[32];
+
+static void reset_config()
+{
+	config_cnf = false;
+	config_opb = false;
+	config_comments = false;
+	config_use_xor_clauses = false;
+	config_use_halfadder_clauses = false;
+	config_use_tseitin_adders = false;
+	config_restrict_branching = false;
+	config_use_compact_adders = false;
+}
+
+/* Throw away the output so far, keeping the variables we use */
+static void reset_output()
+{
+	cnf.str("");
+	cnf.clear();
+	opb.str("");
+	opb.clear();
+
+	var_labels.clear();
+}
+
+/* Count the constraints and literal occurrences written to the CNF or
+ * OPB text; "d" lines (--restrict-branching) do not count as clauses
+ * but their variable does as a literal. */
+static void count_output(unsigned long &nr_clauses, unsigned long &nr_literals)
+{
+	nr_clauses = 0;
+	nr_literals = 0;
+
+	std::istringstream cnf_in(cnf.str());
+	std::string line;
+	while (std::getline(cnf_in, line)) {
+		std::istringstream ss(line);
+		std::string token;
+
+		if (!(ss >> token) || token == "c")
+			continue;
+
+		if (token != "d")
+			++nr_clauses;
+
+		do {
+			if (token != "x" && token != "h" && token != "d" && token != "0")
+				++nr_literals;
+		} while (ss >> token);
+	}
+
+	std::istringstream opb_in(opb.str());
+	while (std::getline(opb_in, line)) {
+		if (line.empty() || line[0] == '*')
+			continue;
+
+		++nr_clauses;
+
+		std::istringstream ss(line);
+		std::string token;
+		while (ss >> token) {
+			if (token[0] == 'x' || token[0] == '~')
+				++nr_literals;
+		}
+	}
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static microbench_result measure(const microbench &b, unsigned int nr_repeats, double min_time)
+{
+	microbench_result r;
+
+	reset_config();
+	b.setup();
+
+	/* Calibrate; this also warms up caches such as the half-adder
+	 * tables unless the benchmark clears them itself */
+	reset_output();
+	unsigned long nr_allocations_before = nr_allocations;
+	b.run();
+	r.nr_allocations = nr_allocations - nr_allocations_before;
+	count_output(r.nr_clauses, r.nr_literals);
+
+	/* Find a number of calls that takes at least min_time */
+	r.nr_calls = 1;
+	while (true) {
+		reset_output();
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned long i = 0; i < r.nr_calls; ++i)
+			b.run();
+
+		if (seconds_since(start) >= min_time)
+			break;
+
+		r.nr_calls *= 2;
+	}
+
+	std::vector<double> ns;
+	for (unsigned int i = 0; i < nr_repeats; ++i) {
+		reset_output();
+
+		auto start = std::chrono::steady_clock::now();
+		for (unsigned long j = 0; j < r.nr_calls; ++j)
+			b.run();
+
+		ns.push_back(1e9 * seconds_since(start) / r.nr_calls);
+	}
+
+	reset_output();
+
+	std::sort(ns.begin(), ns.end());
+	r.median_ns = ns[ns.size() / 2];
+	r.min_ns = ns[0];
+	return r;
+}
+
+static std::vector<microbench> all_microbenchmarks()
+{
+	auto cnf_only = []() {
+		config_cnf = true;
+	};
+
+	auto with_xor = []() {
+		config_cnf = true;
+		config_use_xor_clauses = true;
+	};
+
+	auto with_halfadder = []() {
+		config_cnf = true;
+		config_use_halfadder_clauses = true;
+	};
+
+	auto with_tseitin = []() {
+		config_cnf = true;
+		config_use_tseitin_adders = true;
+	};
+
+	auto with_compact = []() {
+		config_opb = true;
+		config_use_compact_adders = true;
+	};
+
+	auto with_restrict_branching = []() {
+		config_cnf = true;
+		config_restrict_branching = true;
+	};
+
+	std::vector<microbench> v = {
+		{"clause/3", cnf_only, []() {
+			clause(vars_r[0], -vars_a[0], vars_b[0]);
+		}},
+		{"clause/5", cnf_only, []() {
+			clause(vars_r[0], -vars_a[0], vars_b[0], -vars_c[0], vars_d[0]);
+		}},
+		{"xor_clause/3", with_xor, []() {
+			xor_clause(-vars_r[0], vars_a[0], vars_b[0]);
+		}},
+		{"xor2/cnf", cnf_only, []() {
+			xor2(vars_r, vars_a, vars_b, 32);
+		}},
+		{"xor2/xor", with_xor, []() {
+			xor2(vars_r, vars_a, vars_b, 32);
+		}},
+		{"xor3/cnf", cnf_only, []() {
+			xor3(vars_r, vars_a, vars_b, vars_c);
+		}},
+		{"xor3/xor", with_xor, []() {
+			xor3(vars_r, vars_a, vars_b, vars_c);
+		}},
+		{"xor4/cnf", cnf_only, []() {
+			xor4(vars_r, vars_a, vars_b, vars_c, vars_d);
+		}},
+		{"xor4/xor", with_xor, []() {
+			xor4(vars_r, vars_a, vars_b, vars_c, vars_d);
+		}},
+		{"add2/espresso", cnf_only, []() {
+			add2("r", vars_r, vars_a, vars_b);
+		}},
+		{"add2/halfadder", with_halfadder, []() {
+			add2("r", vars_r, vars_a, vars_b);
+		}},
+		{"add2/tseitin", with_tseitin, []() {
+			add2("r", vars_r, vars_a, vars_b);
+		}},
+		{"add2/compact", with_compact, []() {
+			add2("r", vars_r, vars_a, vars_b);
+		}},
+		{"add5/espresso", cnf_only, []() {
+			add5("r", vars_r, vars_a, vars_b, vars_c, vars_d, vars_e);
+		}},
+		{"add5/halfadder", with_halfadder, []() {
+			add5("r", vars_r, vars_a, vars_b, vars_c, vars_d, vars_e);
+		}},
+		{"add5/tseitin", with_tseitin, []() {
+			add5("r", vars_r, vars_a, vars_b, vars_c, vars_d, vars_e);
+		}},
+		{"add5/compact", with_compact, []() {
+			add5("r", vars_r, vars_a, vars_b, vars_c, vars_d, vars_e);
+		}},
+		{"halfadder/hit", cnf_only, []() {
+			halfadder({vars_a[0], vars_b[0], vars_c[0], vars_d[0], vars_e[0]}, {vars_r[0], vars_r[1], vars_r[2]});
+		}},
+		{"halfadder/miss", cnf_only, []() {
+			halfadder_cache.clear();
+			halfadder({vars_a[0], vars_b[0], vars_c[0], vars_d[0], vars_e[0]}, {vars_r[0], vars_r[1], vars_r[2]});
+		}},
+		{"new_vars/32", cnf_only, []() {
+			int x[32];
+			new_vars("x", x, 32, ROLE_TEMPORARY);
+		}},
+		{"new_vars/32/restrict-branching", with_restrict_branching, []() {
+			int x[32];
+			new_vars("x", x, 32, ROLE_TEMPORARY);
+		}},
+		{"format", cnf_only, []() {
+			std::string s = format("$$ ", "-", vars_a[0]);
+			asm volatile("" : : "r" (s.data()) : "memory");
+		}},
+	};
+
+	return v;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> filters;
+	unsigned int nr_repeats = 11;
+	double min_time = 0.05;
+	int cpu = -1;
+
+	{
+		using namespace boost::program_options;
+
+		options_description options("Options");
+		options.add_options()
+			("help,h", "Display this information")
+			("filter", value<std::vector<std::string>>(&filters), "Only run benchmarks whose name contains this string")
+			("repeat", value<unsigned int>(&nr_repeats), "Number of timed repetitions; the median is reported")
+			("min-time", value<double>(&min_time), "Minimum length of a repetition in seconds")
+			("cpu", value<int>(&cpu), "CPU to pin to (default: the one we start on)")
+		;
+
+		variables_map map;
+		store(parse_command_line(argc, argv, options), map);
+		notify(map);
+
+		if (map.count("help")) {
+			std::cout << options;
+			return 0;
+		}
+	}
+
+	if (!nr_repeats)
+		nr_repeats = 1;
+
+	if (cpu < 0)
+		cpu = sched_getcpu();
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+		std::cerr << format("could not pin to CPU $\n", cpu);
+		return EXIT_FAILURE;
+	}
+
+	new_vars("a", vars_a, 32, ROLE_TEMPORARY);
+	new_vars("b", vars_b, 32, ROLE_TEMPORARY);
+	new_vars("c", vars_c, 32, ROLE_TEMPORARY);
+	new_vars("d", vars_d, 32, ROLE_TEMPORARY);
+	new_vars("e", vars_e, 32, ROLE_TEMPORARY);
+	new_vars("r", vars_r, 32, ROLE_TEMPORARY);
+
+	std::vector<microbench> benchmarks;
+	for (const microbench &b: all_microbenchmarks()) {
+		bool match = filters.empty();
+		for (const std::string &f: filters) {
+			if (b.name.find(f) != std::string::npos)
+				match = true;
+		}
+
+		if (match)
+			benchmarks.push_back(b);
+	}
+
+	std::vector<microbench_result> results;
+	try {
+		for (const microbench &b: benchmarks) {
+			results.push_back(measure(b, nr_repeats, min_time));
+			std::cerr << format("$: $ ns\n", b.name, results.back().median_ns);
+		}
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "{\n";
+	std::cout << format("\t\"cpu\": $,\n", cpu);
+	std::cout << format("\t\"repeat\": $,\n", nr_repeats);
+	std::cout << format("\t\"min_time\": $,\n", min_time);
+	std::cout << "\t\"results\": [\n";
+
+	for (unsigned int i = 0; i < results.size(); ++i) {
+		const microbench_result &r = results[i];
+
+		std::string per_clause = r.nr_clauses ? format("$", r.median_ns / r.nr_clauses) : "null";
+		std::string per_literal = r.nr_literals ? format("$", r.median_ns / r.nr_literals) : "null";
+
+		std::cout << format("\t\t{\"name\": \"$\", \"calls\": $, \"ns_per_call\": $, \"min_ns_per_call\": $, \"clauses\": $, \"literals\": $, \"ns_per_clause\": $, \"ns_per_literal\": $, \"allocations\": $}$\n",
+			benchmarks[i].name, r.nr_calls, r.median_ns, r.min_ns, r.nr_clauses, r.nr_literals,
+			per_clause, per_literal, r.nr_allocations, i + 1 < results.size() ? "," : "");
+	}
+
+	std::cout << "\t]\n";
+	std::cout << "}\n";
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+#ifndef PREDICT_HH
+#define PREDICT_HH
+
+/*
+ * Size of an instance, computed without generating it.
+ *
+ * This follows the structure of main.cc: every count depends only on the
+ * number of rounds, the attack, the number of fixed bits and the encoding
+ * flags. The only data needed are the sizes of the half-adder tables,
+ * which are read from data/ like the generator does. The counts are
+ * exact; the byte size is an estimate (it depends on the digits of the
+ * variable numbers and on the comments).
+ *
+ * Keep this in sync with main.cc; "main --stats" and "main --check"
+ * compare the real counts with it and fail if they differ.
+ */
+
+#include <cmath>
+#include <string>
+
+#include "halfadder.hh"
+
+struct size_config {
+	std::string attack;
+	unsigned int nr_rounds;
+	unsigned int nr_message_bits;
+	unsigned int nr_hash_bits;
+
+	bool cnf;
+	bool opb;
+	bool comments;
+	bool use_xor_clauses;
+	bool use_halfadder_clauses;
+	bool use_tseitin_adders;
+	bool restrict_branching;
+	bool use_compact_adders;
+};
+
+struct instance_size {
+	unsigned long nr_variables;
+
+	/* The CNF header count (no XOR or half-adder lines) */
+	unsigned long nr_clauses;
+	unsigned long nr_literals;
+
+	/* The OPB header count */
+	unsigned long nr_constraints;
+
+	unsigned long nr_xor_clauses;
+	unsigned long nr_xor_literals;
+	unsigned long nr_halfadders;
+	unsigned long nr_halfadder_literals;
+
+	/* Half-adder and compact adder PB constraints */
+	unsigned long nr_pb_constraints;
+	unsigned long nr_pb_terms;
+
+	/* "c"/"*" comment lines */
+	unsigned long nr_comments;
+
+	unsigned long estimated_bytes;
+};
+
+class size_model {
+public:
+	size_model(const size_config &config):
+		config(config),
+		size()
+	{
+	}
+
+	instance_size predict()
+	{
+		unsigned int nr_copies = config.attack == "collision" ? 2 : 1;
+
+		/* The header comments and the seed */
+		size.nr_comments += 7;
+
+		for (unsigned int i = 0; i < nr_copies; ++i)
+			sha1();
+
+		if (config.attack == "collision") {
+			size.nr_comments += 2;
+
+			/* One differing message bit and nr_hash_bits equal hash bits */
+			for (unsigned int i = 0; i < 1 + config.nr_hash_bits; ++i) {
+				if (config.use_xor_clauses)
+					xor_clause(2);
+				else
+					clauses(2, 2);
+			}
+		} else {
+			size.nr_comments += 2;
+			clauses(config.nr_message_bits + config.nr_hash_bits, 1);
+		}
+
+		size.nr_constraints = size.nr_clauses + size.nr_pb_constraints;
+		size.estimated_bytes = estimate_bytes();
+		return size;
+	}
+
+private:
+	size_config config;
+	instance_size size;
+
+	/* Every new_vars() call writes a "var" comment (and --restrict-branching "d" lines) */
+	void vars(unsigned long n)
+	{
+		size.nr_variables += n;
+		size.nr_comments += 1;
+	}
+
+	void clauses(unsigned long n, unsigned int length)
+	{
+		size.nr_clauses += n;
+		size.nr_literals += n * length;
+	}
+
+	void xor_clause(unsigned int length)
+	{
+		size.nr_xor_clauses += 1;
+		size.nr_xor_literals += length;
+	}
+
+	void xor_n(unsigned int n, unsigned int nr_inputs)
+	{
+		if (config.use_xor_clauses) {
+			for (unsigned int i = 0; i < n; ++i)
+				xor_clause(nr_inputs + 1);
+		} else {
+			clauses(n << nr_inputs, nr_inputs + 1);
+		}
+	}
+
+	void constant32()
+	{
+		size.nr_comments += 1;
+		clauses(32, 1);
+	}
+
+	void halfadder(unsigned int n, unsigned int m)
+	{
+		if (config.use_halfadder_clauses) {
+			size.nr_halfadders += 1;
+			size.nr_halfadder_literals += n + m;
+		} else {
+			for (const std::vector<int> &c: halfadder_table(n, m))
+				clauses(1, c.size());
+		}
+
+		size.nr_pb_constraints += 1;
+		size.nr_pb_terms += n + m;
+	}
+
+	void tseitin_add2()
+	{
+		vars(31);
+		vars(31);
+		vars(31);
+		vars(31);
+
+		/* and2(1), xor2(1) */
+		clauses(1, 3);
+		clauses(2, 2);
+		xor_n(1, 2);
+
+		/* xor2(31), and2(31), and2(31), or2(30), xor2(31) */
+		size.nr_comments += 3;
+		xor_n(31, 2);
+		clauses(31, 3);
+		clauses(62, 2);
+		clauses(31, 3);
+		clauses(62, 2);
+		clauses(30, 3);
+		clauses(60, 2);
+		xor_n(31, 2);
+	}
+
+	/* Column-wise adder with nr_operands 32-bit operands */
+	void espresso_add(unsigned int nr_operands)
+	{
+		unsigned int nr_addends[32 + 5];
+		for (unsigned int i = 0; i < 32 + 5; ++i)
+			nr_addends[i] = i < 32 ? nr_operands : 0;
+
+		for (unsigned int i = 0; i < 32; ++i) {
+			unsigned int m = floor(log2(nr_addends[i]));
+			vars(m);
+
+			for (unsigned int j = 1; j < 1 + m; ++j)
+				++nr_addends[i + j];
+
+			halfadder(nr_addends[i], 1 + m);
+		}
+	}
+
+	void add2()
+	{
+		size.nr_comments += 1;
+
+		if (config.use_tseitin_adders) {
+			tseitin_add2();
+		} else if (config.use_compact_adders) {
+			vars(1);
+			size.nr_pb_constraints += 1;
+			size.nr_pb_terms += 3 * 32 + 1;
+		} else {
+			espresso_add(2);
+		}
+	}
+
+	void add5()
+	{
+		size.nr_comments += 1;
+
+		if (config.use_tseitin_adders) {
+			vars(32);
+			vars(32);
+			vars(32);
+
+			for (unsigned int i = 0; i < 4; ++i)
+				add2();
+		} else if (config.use_compact_adders) {
+			vars(3);
+			size.nr_pb_constraints += 1;
+			size.nr_pb_terms += 6 * 32 + 3;
+		} else {
+			espresso_add(5);
+		}
+	}
+
+	void sha1()
+	{
+		unsigned int nr_rounds = config.nr_rounds;
+
+		/* "sha1" and "parameter nr_rounds" */
+		size.nr_comments += 2;
+
+		/* w[0..15], w[16..], h_in, h_out, a[] */
+		for (unsigned int i = 0; i < 16; ++i)
+			vars(32);
+		for (unsigned int i = 16; i < nr_rounds; ++i)
+			vars(32);
+		for (unsigned int i = 0; i < 10; ++i)
+			vars(32);
+		for (unsigned int i = 0; i < nr_rounds; ++i)
+			vars(32);
+
+		/* Message expansion */
+		for (unsigned int i = 16; i < nr_rounds; ++i) {
+			size.nr_comments += 1;
+			xor_n(32, 4);
+		}
+
+		/* k[0..3] and h_in */
+		for (unsigned int i = 0; i < 4; ++i) {
+			vars(32);
+			constant32();
+		}
+
+		for (unsigned int i = 0; i < 5; ++i)
+			constant32();
+
+		for (unsigned int i = 0; i < nr_rounds; ++i) {
+			vars(32);
+
+			if (i < 20 || (i >= 40 && i < 60)) {
+				clauses(6 * 32, 3);
+			} else {
+				size.nr_comments += 1;
+				xor_n(32, 3);
+			}
+
+			add5();
+		}
+
+		for (unsigned int i = 0; i < 5; ++i)
+			add2();
+	}
+
+	unsigned long estimate_bytes() const
+	{
+		/* Average length of a variable number */
+		double digits = 0;
+		for (unsigned long p = 1; p <= size.nr_variables; p *= 10)
+			digits += (double) (size.nr_variables - p + 1) / std::max(size.nr_variables, 1UL);
+
+		/* About half the literals are negative */
+		double literal = digits + 1.5;
+
+		double bytes = 0;
+		if (config.cnf) {
+			bytes += 32;
+			bytes += size.nr_literals * literal + size.nr_clauses * 2;
+			bytes += size.nr_xor_literals * literal + size.nr_xor_clauses * 4;
+			bytes += size.nr_halfadder_literals * (digits + 1) + size.nr_halfadders * 6;
+			if (config.restrict_branching)
+				bytes += size.nr_variables * (digits + 5);
+			if (config.comments)
+				bytes += size.nr_comments * 24.0;
+		}
+
+		if (config.opb) {
+			bytes += 48;
+			bytes += size.nr_literals * (literal + 3) + size.nr_clauses * 6;
+
+			/* Coefficients are powers of two of up to 10 digits */
+			bytes += size.nr_pb_terms * (digits + 9) + size.nr_pb_constraints * 5;
+			if (config.comments)
+				bytes += size.nr_comments * 24.0;
+		}
+
+		return bytes;
+	}
+};
+
+static inline instance_size predict_size(const size_config &config)
+{
+	return size_model(config).predict();
+}
+
+#endif
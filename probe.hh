@@ -0,0 +1,414 @@
+#ifndef PROBE_HH
+#define PROBE_HH
+
+/*
+ * Failed-literal probing and equivalent-literal substitution of a set of
+ * clauses (--probe).
+ *
+ * Each candidate variable x is assigned true and then false, and unit
+ * propagation is run over the clauses with two watched literals per
+ * clause. If one value leads to a conflict, x gets the other value for
+ * good (a failed literal); a literal implied by both values is a unit;
+ * and a variable y that is implied true by one value and false by the
+ * other is equivalent to x or ~x. Equivalent variables are replaced by
+ * one representative of their class when the clauses are written.
+ *
+ * Protected variables are never removed: they are preferred as
+ * representatives, get a unit clause if their value is known, and are
+ * tied to their representative with two binary clauses otherwise.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+class prober {
+public:
+	unsigned long nr_probed;
+	unsigned long nr_failed;
+	unsigned long nr_units;
+	unsigned long nr_equivalences;
+
+	/* Clauses visited by unit propagation; run() stops probing when
+	 * this reaches the budget, which keeps the result the same on any
+	 * machine */
+	uint64_t nr_visits;
+
+	/* The clauses were found to be unsatisfiable */
+	bool empty_clause;
+
+	prober(unsigned int nr_variables):
+		nr_probed(0),
+		nr_failed(0),
+		nr_units(0),
+		nr_equivalences(0),
+		nr_visits(0),
+		empty_clause(false),
+		watches(2 * (nr_variables + 1)),
+		values(nr_variables + 1, 0),
+		head(0),
+		stamps(2 * (nr_variables + 1), 0),
+		stamp(0),
+		is_protected(nr_variables + 1, false),
+		representative(nr_variables + 1)
+	{
+		for (unsigned int i = 0; i <= nr_variables; ++i)
+			representative[i] = i;
+	}
+
+	void protect(int x)
+	{
+		is_protected[abs(x)] = true;
+	}
+
+	void add_clause(const int *v, unsigned int n)
+	{
+		std::vector<int> lits(v, v + n);
+		std::sort(lits.begin(), lits.end());
+		lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+
+		for (int x: lits) {
+			if (std::binary_search(lits.begin(), lits.end(), -x))
+				return;
+		}
+
+		if (lits.empty()) {
+			empty_clause = true;
+			return;
+		}
+
+		if (lits.size() == 1) {
+			initial_units.push_back(lits[0]);
+			return;
+		}
+
+		unsigned int i = clauses.size();
+		clauses.push_back(lits);
+		watches[index(lits[0])].push_back(i);
+		watches[index(lits[1])].push_back(i);
+	}
+
+	/* Probe the candidates in order until the budget of clause visits
+	 * is used up */
+	void run(const std::vector<int> &candidates, uint64_t budget)
+	{
+		for (int x: initial_units)
+			learn(x);
+
+		for (int x: candidates) {
+			if (empty_clause || nr_visits >= budget)
+				break;
+			if (values[abs(x)] || find(abs(x)) != abs(x))
+				continue;
+
+			probe(abs(x));
+		}
+
+		/* Point every variable straight at its representative and give
+		 * a class the value of any of its variables (an equivalence
+		 * says that x implies ~y, but propagation does not get x from
+		 * y) */
+		for (unsigned int i = 1; i < values.size(); ++i) {
+			int r = representative[i] = find(i);
+			if (!values[i] || r == (int) i)
+				continue;
+
+			if (value(r) == -values[i])
+				empty_clause = true;
+			values[abs(r)] = r < 0 ? -values[i] : values[i];
+		}
+
+		for (unsigned int i = 1; i < values.size(); ++i)
+			values[i] = value(representative[i]);
+	}
+
+	/* Whether x no longer occurs in the clauses; extend() gives it a
+	 * value */
+	bool removed(int x) const
+	{
+		x = abs(x);
+		return !is_protected[x] && (values[x] || representative[x] != x);
+	}
+
+	/* The simplified clauses: units and equivalences of protected
+	 * variables first */
+	template<typename F>
+	void for_each_clause(F f) const
+	{
+		if (empty_clause) {
+			f(std::vector<int>());
+			return;
+		}
+
+		for (unsigned int x = 1; x < values.size(); ++x) {
+			if (is_protected[x] && values[x])
+				f(std::vector<int>(1, values[x] > 0 ? x : -x));
+		}
+
+		for (unsigned int x = 1; x < values.size(); ++x) {
+			int r = representative[x];
+			if (is_protected[x] && !values[x] && r != (int) x) {
+				f(std::vector<int>{-(int) x, r});
+				f(std::vector<int>{(int) x, -r});
+			}
+		}
+
+		/* Substitution can make clauses equal */
+		std::set<std::vector<int>> seen;
+		std::vector<int> lits;
+		for (const std::vector<int> &c: clauses) {
+			if (!substitute(c, lits))
+				continue;
+			if (!seen.insert(lits).second)
+				continue;
+
+			f(lits);
+		}
+	}
+
+	/* Give the removed variables values that make a model of the
+	 * simplified clauses a model of the original ones */
+	void extend(std::vector<bool> &model) const
+	{
+		for (unsigned int x = 1; x < values.size(); ++x) {
+			if (removed(x) && values[x])
+				model[x] = values[x] > 0;
+		}
+
+		for (unsigned int x = 1; x < values.size(); ++x) {
+			int r = representative[x];
+			if (removed(x) && !values[x])
+				model[x] = model[abs(r)] == (r > 0);
+		}
+	}
+
+private:
+	std::vector<std::vector<int>> clauses;
+	std::vector<int> initial_units;
+
+	/* Clauses that watch each literal; the watched literals of a clause
+	 * are its first two */
+	std::vector<std::vector<unsigned int>> watches;
+
+	/* 1, -1 or 0; the assignments before `head` on the trail have been
+	 * propagated. When no variable is being probed, everything on the
+	 * trail holds in every model. */
+	std::vector<int8_t> values;
+	std::vector<int> trail;
+	unsigned int head;
+
+	std::vector<unsigned int> stamps;
+	unsigned int stamp;
+
+	std::vector<bool> is_protected;
+
+	/* Union-find of equivalent literals: variable x is equivalent to
+	 * the literal representative[x], and roots point to themselves */
+	std::vector<int> representative;
+
+	static unsigned int index(int x)
+	{
+		return 2 * abs(x) + (x < 0);
+	}
+
+	int value(int x) const
+	{
+		return x < 0 ? -values[-x] : values[x];
+	}
+
+	void assign(int x)
+	{
+		values[abs(x)] = x < 0 ? -1 : 1;
+		trail.push_back(x);
+	}
+
+	void backtrack(unsigned int size)
+	{
+		while (trail.size() > size) {
+			values[abs(trail.back())] = 0;
+			trail.pop_back();
+		}
+
+		head = size;
+	}
+
+	/* Whether propagation finished without a conflict */
+	bool propagate()
+	{
+		while (head < trail.size()) {
+			int x = -trail[head++];
+			std::vector<unsigned int> &w = watches[index(x)];
+
+			unsigned int j = 0;
+			for (unsigned int i = 0; i < w.size(); ++i) {
+				unsigned int k = w[i];
+				std::vector<int> &lits = clauses[k];
+				++nr_visits;
+
+				if (lits[0] == x)
+					std::swap(lits[0], lits[1]);
+
+				if (value(lits[0]) > 0) {
+					w[j++] = k;
+					continue;
+				}
+
+				/* Look for a new literal to watch */
+				bool moved = false;
+				for (unsigned int l = 2; l < lits.size(); ++l) {
+					if (value(lits[l]) >= 0) {
+						std::swap(lits[1], lits[l]);
+						watches[index(lits[1])].push_back(k);
+						moved = true;
+						break;
+					}
+				}
+
+				if (moved)
+					continue;
+
+				w[j++] = k;
+				if (value(lits[0]) < 0) {
+					while (++i < w.size())
+						w[j++] = w[i];
+					w.resize(j);
+					return false;
+				}
+
+				assign(lits[0]);
+			}
+
+			w.resize(j);
+		}
+
+		return true;
+	}
+
+	/* Assign x for good */
+	void learn(int x)
+	{
+		if (value(x) > 0)
+			return;
+		if (value(x) < 0) {
+			empty_clause = true;
+			return;
+		}
+
+		assign(x);
+		if (!propagate())
+			empty_clause = true;
+	}
+
+	void probe(int x)
+	{
+		++nr_probed;
+
+		unsigned int size = trail.size();
+		assign(x);
+		if (!propagate()) {
+			backtrack(size);
+			++nr_failed;
+			learn(-x);
+			return;
+		}
+
+		++stamp;
+		for (unsigned int i = size + 1; i < trail.size(); ++i)
+			stamps[index(trail[i])] = stamp;
+		backtrack(size);
+
+		assign(-x);
+		if (!propagate()) {
+			backtrack(size);
+			++nr_failed;
+			learn(x);
+			return;
+		}
+
+		std::vector<int> units;
+		std::vector<int> equivalent;
+		for (unsigned int i = size + 1; i < trail.size(); ++i) {
+			int y = trail[i];
+			if (stamps[index(y)] == stamp)
+				units.push_back(y);
+			else if (stamps[index(-y)] == stamp)
+				equivalent.push_back(y);
+		}
+		backtrack(size);
+
+		for (int y: units) {
+			++nr_units;
+			learn(y);
+		}
+
+		/* ~x implies y and x implies ~y */
+		for (int y: equivalent)
+			merge(y, -x);
+	}
+
+	/* The representative literal of literal x */
+	int find(int x)
+	{
+		int r = representative[abs(x)];
+		if (r != abs(x)) {
+			r = find(r);
+			representative[abs(x)] = r;
+		}
+
+		return x < 0 ? -r : r;
+	}
+
+	/* Make x and y equivalent; protected variables and then smaller
+	 * ones are preferred as representatives */
+	void merge(int x, int y)
+	{
+		x = find(x);
+		y = find(y);
+		if (x == y)
+			return;
+		if (x == -y) {
+			empty_clause = true;
+			return;
+		}
+
+		if (is_protected[abs(x)] > is_protected[abs(y)]
+			|| (is_protected[abs(x)] == is_protected[abs(y)] && abs(x) < abs(y)))
+		{
+			std::swap(x, y);
+		}
+
+		representative[abs(x)] = x < 0 ? -y : y;
+		++nr_equivalences;
+	}
+
+	/* c with the known and equivalent literals replaced, or false if it
+	 * is satisfied */
+	bool substitute(const std::vector<int> &c, std::vector<int> &lits) const
+	{
+		lits.clear();
+		for (int x: c) {
+			int v = value(x);
+			if (v > 0)
+				return false;
+			if (v < 0)
+				continue;
+
+			int r = representative[abs(x)];
+			lits.push_back(x < 0 ? -r : r);
+		}
+
+		std::sort(lits.begin(), lits.end());
+		lits.erase(std::unique(lits.begin(), lits.end()), lits.end());
+
+		for (int x: lits) {
+			if (std::binary_search(lits.begin(), lits.end(), -x))
+				return false;
+		}
+
+		return true;
+	}
+};
+
+#endif
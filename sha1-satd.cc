@@ -0,0 +1,514 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Generator daemon.
+ *
+ * Listens on a Unix domain socket and generates one instance per
+ * connection. The half-adder tables are loaded once at startup; every
+ * request is handled by a forked child, which starts with the tables
+ * already in memory and otherwise the same fresh state as a new process
+ * (the generator keeps its state in globals, so requests cannot share a
+ * process). At most --jobs requests are generated at the same time.
+ *
+ * A request is the command line arguments of main, each terminated by a
+ * NUL byte, followed by an empty argument:
+ *
+ *     --cnf\0--rounds=20\0--seed=1\0\0
+ *
+ * A request that has not arrived in full after 10 seconds is dropped
+ * like a truncated one, so idle clients cannot hold on to the job slots.
+ *
+ * The extra argument --memfd asks for the instance in a sealed memfd
+ * instead of on the socket. The response starts with the line
+ *
+ *     <exit status> <instance bytes> <error bytes>\n
+ *
+ * followed by the error output of the generator and then the instance.
+ * With --memfd the descriptor is passed (SCM_RIGHTS) along with the
+ * first line and the instance itself does not follow.
+ *
+ * Anyone who can connect to the socket can send requests, so requests
+ * may not use the options that run a command (--shm-solver) or write
+ * files (--map, --stats, --trace, ...) as the daemon's user, and the
+ * socket is only accessible to that user. Files that requests read
+ * (--targets) are opened by the daemon.
+ * "sha1-satd --socket=<path> -- <arguments>" sends one request and
+ * prints the result, like running main with the same arguments.
+ */
+
+#define SHA1_SAT_NO_MAIN
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-variable"
+#include "main.cc"
+#pragma GCC diagnostic pop
+
+#include <csignal>
+#include <thread>
+
+extern "C" {
+#include <dirent.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+}
+
+#define MAX_REQUEST_SIZE (1 << 16)
+
+/* A client that has not sent its whole request by then holds a job slot
+ * for nothing */
+#define REQUEST_TIMEOUT_MS 10000
+
+static void write_all(int fd, const char *p, size_t n)
+{
+	while (n) {
+		ssize_t len = write(fd, p, n);
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			throw std::runtime_error("write() failed");
+
+		p += len;
+		n -= len;
+	}
+}
+
+/* Read from the socket until n bytes or EOF; returns the number read */
+static size_t read_all(int fd, char *p, size_t n)
+{
+	size_t r = 0;
+	while (r < n) {
+		ssize_t len = read(fd, p + r, n - r);
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		r += len;
+	}
+
+	return r;
+}
+
+static void send_file(int out, int in, off_t size)
+{
+	off_t offset = 0;
+	while (offset < size) {
+		ssize_t len = sendfile(out, in, &offset, size - offset);
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			throw std::runtime_error("sendfile() failed");
+	}
+}
+
+static off_t file_size(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		throw std::runtime_error("fstat() failed");
+
+	return st.st_size;
+}
+
+/* Load every half-adder table in data/ so that requests never do */
+static void load_tables()
+{
+	DIR *d = opendir("data");
+	if (!d)
+		throw std::runtime_error("could not open data/");
+
+	while (struct dirent *e = readdir(d)) {
+		unsigned int n, m;
+		char rest[16];
+		if (sscanf(e->d_name, "halfadder-%u-%u.%15s", &n, &m, rest) == 3 && !strcmp(rest, "out.txt"))
+			halfadder_table(n, m);
+	}
+
+	closedir(d);
+}
+
+static std::vector<std::string> read_request(int fd)
+{
+	std::vector<std::string> args;
+	std::string arg;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+
+	static char buf[4096];
+	size_t total = 0;
+	while (true) {
+		long remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+			deadline - std::chrono::steady_clock::now()).count();
+		if (remaining <= 0)
+			throw std::runtime_error("truncated request (timed out)");
+
+		struct pollfd p;
+		p.fd = fd;
+		p.events = POLLIN;
+		int ready = poll(&p, 1, remaining);
+		if (ready == -1 && errno == EINTR)
+			continue;
+		if (ready == -1)
+			throw std::runtime_error("poll() failed");
+		if (ready == 0)
+			continue;
+
+		ssize_t len = read(fd, buf, sizeof(buf));
+		if (len == -1 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			throw std::runtime_error("truncated request");
+
+		total += len;
+		if (total > MAX_REQUEST_SIZE)
+			throw std::runtime_error("request too large");
+
+		for (ssize_t i = 0; i < len; ++i) {
+			if (buf[i]) {
+				arg += buf[i];
+			} else if (arg.empty()) {
+				return args;
+			} else {
+				args.push_back(arg);
+				arg.clear();
+			}
+		}
+	}
+}
+
+/* Runs in the forked child; the generator's output goes to memfds */
+static void serve_request(int client)
+{
+	std::vector<std::string> args = read_request(client);
+
+	bool use_memfd = false;
+	std::vector<std::string> argv_strings = {"sha1-satd"};
+	for (const std::string &arg: args) {
+		if (arg == "--memfd")
+			use_memfd = true;
+		else
+			argv_strings.push_back(arg);
+	}
+
+	config_untrusted_arguments = true;
+
+	std::vector<char *> argv;
+	for (std::string &arg: argv_strings)
+		argv.push_back(&arg[0]);
+	argv.push_back(0);
+
+	int out = memfd_create("sha1-satd", MFD_ALLOW_SEALING);
+	int err = memfd_create("sha1-satd-errors", 0);
+	if (out == -1 || err == -1)
+		throw std::runtime_error("memfd_create() failed");
+
+	dup2(out, STDOUT_FILENO);
+	dup2(err, STDERR_FILENO);
+
+	int status;
+	try {
+		status = generator_main(argv.size() - 1, &argv[0]);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		status = EXIT_FAILURE;
+	}
+
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(stdout);
+	fflush(stderr);
+
+	off_t out_size = file_size(out);
+	off_t err_size = file_size(err);
+
+	std::string header = format("$ $ $\n", status, out_size, err_size);
+
+	struct iovec iov;
+	iov.iov_base = &header[0];
+	iov.iov_len = header.size();
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	char control[CMSG_SPACE(sizeof(int))];
+	if (use_memfd) {
+		if (fcntl(out, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+			throw std::runtime_error("fcntl(F_ADD_SEALS) failed");
+
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(c), &out, sizeof(int));
+	}
+
+	if (sendmsg(client, &msg, 0) != (ssize_t) header.size())
+		throw std::runtime_error("sendmsg() failed");
+
+	send_file(client, err, err_size);
+	if (!use_memfd)
+		send_file(client, out, out_size);
+}
+
+static int listen_on(const std::string &path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error("socket path too long");
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		throw std::runtime_error("socket() failed");
+
+	/* Replace a stale socket, but not a file at a mistyped path */
+	struct stat st;
+	if (lstat(path.c_str(), &st) == 0) {
+		if (!S_ISSOCK(st.st_mode))
+			throw std::runtime_error(format("$: exists and is not a socket", path));
+
+		unlink(path.c_str());
+	}
+
+	/* Mode 0600 from the start, not after a chmod() */
+	mode_t mask = umask(0177);
+	int r = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+	if (r == -1)
+		throw std::runtime_error(format("$: could not bind", path));
+	if (listen(fd, 128) == -1)
+		throw std::runtime_error("listen() failed");
+
+	return fd;
+}
+
+/* Children are reaped as soon as they finish; SIGCHLD is blocked except
+ * while the daemon waits, so nr_running only changes then */
+static volatile sig_atomic_t nr_running = 0;
+
+static void reap_children(int)
+{
+	int saved_errno = errno;
+	while (waitpid(-1, NULL, WNOHANG) > 0)
+		--nr_running;
+	errno = saved_errno;
+}
+
+static int daemon_main(const std::string &path, unsigned int nr_jobs)
+{
+	load_tables();
+
+	int server = listen_on(path);
+	std::cerr << format("sha1-satd: listening on $ with $ jobs\n", path, nr_jobs);
+
+	/* A client that goes away only kills its own child */
+	signal(SIGPIPE, SIG_IGN);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = reap_children;
+	sa.sa_flags = SA_NOCLDSTOP;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	sigset_t sigchld, unblocked;
+	sigemptyset(&sigchld);
+	sigaddset(&sigchld, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sigchld, &unblocked);
+
+	while (true) {
+		while (nr_running >= (sig_atomic_t) nr_jobs)
+			sigsuspend(&unblocked);
+
+		sigprocmask(SIG_SETMASK, &unblocked, NULL);
+		int client = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+		int accept_errno = errno;
+		sigprocmask(SIG_BLOCK, &sigchld, NULL);
+
+		if (client == -1) {
+			if (accept_errno == EINTR || accept_errno == ECONNABORTED)
+				continue;
+			throw std::runtime_error("accept() failed");
+		}
+
+		pid_t child = fork();
+		if (child == -1) {
+			close(client);
+			std::cerr << "sha1-satd: fork() failed\n";
+			continue;
+		}
+
+		if (child == 0) {
+			close(server);
+			signal(SIGCHLD, SIG_DFL);
+			sigprocmask(SIG_SETMASK, &unblocked, NULL);
+
+			try {
+				serve_request(client);
+			} catch (const std::exception &) {
+				/* Standard error is a memfd by now */
+				_exit(EXIT_FAILURE);
+			}
+
+			_exit(0);
+		}
+
+		close(client);
+		++nr_running;
+	}
+}
+
+/* Send one request and print the result */
+static int client_main(const std::string &path, const std::vector<std::string> &args)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error("socket path too long");
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		throw std::runtime_error("socket() failed");
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1)
+		throw std::runtime_error(format("$: could not connect", path));
+
+	std::string request;
+	for (const std::string &arg: args)
+		request += arg + '\0';
+	request += '\0';
+	write_all(fd, request.data(), request.size());
+
+	/* The first line, and the memfd if there is one */
+	char header[64];
+	char control[CMSG_SPACE(sizeof(int))];
+
+	struct iovec iov;
+	iov.iov_base = header;
+	iov.iov_len = sizeof(header) - 1;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	ssize_t len = recvmsg(fd, &msg, 0);
+	if (len <= 0)
+		throw std::runtime_error("no response");
+	header[len] = '\0';
+
+	int memfd = -1;
+	for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+			memcpy(&memfd, CMSG_DATA(c), sizeof(int));
+	}
+
+	char *newline = strchr(header, '\n');
+	int status;
+	unsigned long out_size, err_size;
+	if (!newline || sscanf(header, "%d %lu %lu", &status, &out_size, &err_size) != 3)
+		throw std::runtime_error("malformed response");
+
+	/* Whatever came after the first line is already part of the data */
+	std::string data(newline + 1, header + len);
+	data.resize(err_size + (memfd == -1 ? out_size : 0));
+	size_t have = len - (newline + 1 - header);
+	if (have < data.size() && read_all(fd, &data[have], data.size() - have) != data.size() - have)
+		throw std::runtime_error("truncated response");
+
+	close(fd);
+
+	write_all(STDERR_FILENO, data.data(), err_size);
+
+	if (memfd == -1) {
+		write_all(STDOUT_FILENO, data.data() + err_size, out_size);
+	} else {
+		send_file(STDOUT_FILENO, memfd, out_size);
+		close(memfd);
+	}
+
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string path = "sha1-satd.sock";
+	unsigned int nr_jobs = std::max(1U, std::thread::hardware_concurrency());
+
+	/* Everything after "--" is a request */
+	int nr_daemon_args = argc;
+	std::vector<std::string> request;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--")) {
+			nr_daemon_args = i;
+			request.assign(argv + i + 1, argv + argc);
+			break;
+		}
+	}
+
+	{
+		using namespace boost::program_options;
+
+		options_description options("Options");
+		options.add_options()
+			("help,h", "Display this information")
+			("socket", value<std::string>(&path), "Path of the Unix domain socket")
+			("jobs", value<unsigned int>(&nr_jobs), "Number of requests to generate at the same time")
+		;
+
+		variables_map map;
+		store(parse_command_line(nr_daemon_args, argv, options), map);
+		notify(map);
+
+		if (map.count("help")) {
+			std::cout << "Usage: sha1-satd [options]\n";
+			std::cout << "       sha1-satd [options] -- <generator arguments>\n\n";
+			std::cout << options;
+			return 0;
+		}
+	}
+
+	if (!nr_jobs)
+		nr_jobs = 1;
+
+	try {
+		if (nr_daemon_args < argc)
+			return client_main(path, request);
+
+		return daemon_main(path, nr_jobs);
+	} catch (const std::exception &e) {
+		std::cerr << "sha1-satd: " << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+}
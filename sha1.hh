@@ -0,0 +1,493 @@
+#ifndef SHA1_HH
+#define SHA1_HH
+
+/*
+ * SHA-1 compression function with support for reduced numbers of rounds.
+ *
+ * sha1_compress() compresses a single block and uses the SHA instruction
+ * set extensions when the CPU has them and the number of rounds is a
+ * multiple of 4. sha1_compress_lanes() compresses SHA1_LANES independent
+ * blocks at once, stored one lane per message ("structure of arrays"),
+ * using AVX-512 or AVX2 when available.
+ *
+ * Message words are host-endian uint32_t values, i.e. what the instances
+ * call w[0..15]; the chaining value h is updated in place, so starting
+ * from sha1_iv gives the hash of a single block (without padding).
+ *
+ * The kernel is picked at runtime; set SHA1_KERNEL to "scalar", "avx2",
+ * "avx512" or "shani" to override the choice (e.g. for benchmarking).
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA1_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#define SHA1_LANES 16
+
+static const uint32_t sha1_iv[5] = {
+	0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0,
+};
+
+static const uint32_t sha1_k[4] = {
+	0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6,
+};
+
+/* The kernels do not rely on the alignment, since objects containing this
+ * may well end up in memory from plain operator new */
+struct sha1_lanes {
+	alignas(64) uint32_t h[5][SHA1_LANES];
+	alignas(64) uint32_t w[16][SHA1_LANES];
+};
+
+static inline uint32_t sha1_rotl(uint32_t x, unsigned int n)
+{
+	return (x << n) | (x >> ((32 - n) & 31));
+}
+
+static inline unsigned int sha1_min(unsigned int a, unsigned int b)
+{
+	return a < b ? a : b;
+}
+
+/*
+ * Scalar
+ */
+
+static void sha1_compress_scalar(unsigned int nr_rounds, uint32_t h[5], const uint32_t w[16])
+{
+	uint32_t x[16];
+	memcpy(x, w, sizeof(x));
+
+	uint32_t a = h[0];
+	uint32_t b = h[1];
+	uint32_t c = h[2];
+	uint32_t d = h[3];
+	uint32_t e = h[4];
+
+#define SHA1_ROUND(f, k) \
+	do { \
+		uint32_t wi = i < 16 ? x[i] : (x[i % 16] = sha1_rotl(x[(i - 3) % 16] ^ x[(i - 8) % 16] ^ x[(i - 14) % 16] ^ x[i % 16], 1)); \
+		uint32_t t = sha1_rotl(a, 5) + (f) + e + (k) + wi; \
+		e = d; \
+		d = c; \
+		c = sha1_rotl(b, 30); \
+		b = a; \
+		a = t; \
+	} while (0)
+
+	unsigned int i = 0;
+	for (; i < sha1_min(nr_rounds, 20); ++i)
+		SHA1_ROUND((b & c) | (~b & d), sha1_k[0]);
+	for (; i < sha1_min(nr_rounds, 40); ++i)
+		SHA1_ROUND(b ^ c ^ d, sha1_k[1]);
+	for (; i < sha1_min(nr_rounds, 60); ++i)
+		SHA1_ROUND((b & c) | (b & d) | (c & d), sha1_k[2]);
+	for (; i < sha1_min(nr_rounds, 80); ++i)
+		SHA1_ROUND(b ^ c ^ d, sha1_k[3]);
+
+#undef SHA1_ROUND
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+}
+
+static void sha1_compress_lanes_scalar(unsigned int nr_rounds, sha1_lanes &s)
+{
+	for (unsigned int lane = 0; lane < SHA1_LANES; ++lane) {
+		uint32_t h[5];
+		uint32_t w[16];
+
+		for (unsigned int i = 0; i < 5; ++i)
+			h[i] = s.h[i][lane];
+		for (unsigned int i = 0; i < 16; ++i)
+			w[i] = s.w[i][lane];
+
+		sha1_compress_scalar(nr_rounds, h, w);
+
+		for (unsigned int i = 0; i < 5; ++i)
+			s.h[i][lane] = h[i];
+	}
+}
+
+#ifdef SHA1_X86
+
+/*
+ * AVX2: 8 lanes per vector, two vectors per call
+ */
+
+__attribute__((target("avx2")))
+static inline __m256i sha1_rotl_avx2(__m256i x, int n)
+{
+	return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n));
+}
+
+__attribute__((target("avx2")))
+static void sha1_compress_avx2_half(unsigned int nr_rounds, sha1_lanes &s, unsigned int offset)
+{
+	__m256i x[16];
+	for (unsigned int i = 0; i < 16; ++i)
+		x[i] = _mm256_loadu_si256((const __m256i *) &s.w[i][offset]);
+
+	__m256i a = _mm256_loadu_si256((const __m256i *) &s.h[0][offset]);
+	__m256i b = _mm256_loadu_si256((const __m256i *) &s.h[1][offset]);
+	__m256i c = _mm256_loadu_si256((const __m256i *) &s.h[2][offset]);
+	__m256i d = _mm256_loadu_si256((const __m256i *) &s.h[3][offset]);
+	__m256i e = _mm256_loadu_si256((const __m256i *) &s.h[4][offset]);
+
+#define SHA1_ROUND(f, k) \
+	do { \
+		if (i >= 16) \
+			x[i % 16] = sha1_rotl_avx2(_mm256_xor_si256(_mm256_xor_si256(x[(i - 3) % 16], x[(i - 8) % 16]), _mm256_xor_si256(x[(i - 14) % 16], x[i % 16])), 1); \
+		__m256i t = _mm256_add_epi32(_mm256_add_epi32(sha1_rotl_avx2(a, 5), (f)), \
+			_mm256_add_epi32(_mm256_add_epi32(e, (k)), x[i % 16])); \
+		e = d; \
+		d = c; \
+		c = sha1_rotl_avx2(b, 30); \
+		b = a; \
+		a = t; \
+	} while (0)
+
+	unsigned int i = 0;
+
+	__m256i k0 = _mm256_set1_epi32(sha1_k[0]);
+	for (; i < sha1_min(nr_rounds, 20); ++i)
+		SHA1_ROUND(_mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d))), k0);
+
+	__m256i k1 = _mm256_set1_epi32(sha1_k[1]);
+	for (; i < sha1_min(nr_rounds, 40); ++i)
+		SHA1_ROUND(_mm256_xor_si256(_mm256_xor_si256(b, c), d), k1);
+
+	__m256i k2 = _mm256_set1_epi32(sha1_k[2]);
+	for (; i < sha1_min(nr_rounds, 60); ++i)
+		SHA1_ROUND(_mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c))), k2);
+
+	__m256i k3 = _mm256_set1_epi32(sha1_k[3]);
+	for (; i < sha1_min(nr_rounds, 80); ++i)
+		SHA1_ROUND(_mm256_xor_si256(_mm256_xor_si256(b, c), d), k3);
+
+#undef SHA1_ROUND
+
+	_mm256_storeu_si256((__m256i *) &s.h[0][offset], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &s.h[0][offset]), a));
+	_mm256_storeu_si256((__m256i *) &s.h[1][offset], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &s.h[1][offset]), b));
+	_mm256_storeu_si256((__m256i *) &s.h[2][offset], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &s.h[2][offset]), c));
+	_mm256_storeu_si256((__m256i *) &s.h[3][offset], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &s.h[3][offset]), d));
+	_mm256_storeu_si256((__m256i *) &s.h[4][offset], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) &s.h[4][offset]), e));
+}
+
+__attribute__((target("avx2")))
+static void sha1_compress_lanes_avx2(unsigned int nr_rounds, sha1_lanes &s)
+{
+	sha1_compress_avx2_half(nr_rounds, s, 0);
+	sha1_compress_avx2_half(nr_rounds, s, 8);
+}
+
+/*
+ * AVX-512: all 16 lanes in one vector
+ */
+
+__attribute__((target("avx512f")))
+static inline __m512i sha1_rotl_avx512(__m512i x, int n)
+{
+	/* Same instruction as _mm512_rol_epi32(), but the unmasked forms
+	 * trip -Wmaybe-uninitialized in some versions of the GCC headers */
+	return _mm512_mask_rolv_epi32(x, 0xffff, x, _mm512_set1_epi32(n));
+}
+
+__attribute__((target("avx512f")))
+static void sha1_compress_lanes_avx512(unsigned int nr_rounds, sha1_lanes &s)
+{
+	__m512i x[16];
+	for (unsigned int i = 0; i < 16; ++i)
+		x[i] = _mm512_loadu_si512((const void *) s.w[i]);
+
+	__m512i a = _mm512_loadu_si512((const void *) s.h[0]);
+	__m512i b = _mm512_loadu_si512((const void *) s.h[1]);
+	__m512i c = _mm512_loadu_si512((const void *) s.h[2]);
+	__m512i d = _mm512_loadu_si512((const void *) s.h[3]);
+	__m512i e = _mm512_loadu_si512((const void *) s.h[4]);
+
+#define SHA1_ROUND(f, k) \
+	do { \
+		if (i >= 16) \
+			x[i % 16] = sha1_rotl_avx512(_mm512_ternarylogic_epi32(x[(i - 3) % 16], x[(i - 8) % 16], _mm512_xor_si512(x[(i - 14) % 16], x[i % 16]), 0x96), 1); \
+		__m512i t = _mm512_add_epi32(_mm512_add_epi32(sha1_rotl_avx512(a, 5), (f)), \
+			_mm512_add_epi32(_mm512_add_epi32(e, (k)), x[i % 16])); \
+		e = d; \
+		d = c; \
+		c = sha1_rotl_avx512(b, 30); \
+		b = a; \
+		a = t; \
+	} while (0)
+
+	unsigned int i = 0;
+
+	/* The ternary logic immediates are the truth tables of ch(), parity()
+	 * and maj() with b, c, d as the three inputs. */
+	__m512i k0 = _mm512_set1_epi32(sha1_k[0]);
+	for (; i < sha1_min(nr_rounds, 20); ++i)
+		SHA1_ROUND(_mm512_ternarylogic_epi32(b, c, d, 0xca), k0);
+
+	__m512i k1 = _mm512_set1_epi32(sha1_k[1]);
+	for (; i < sha1_min(nr_rounds, 40); ++i)
+		SHA1_ROUND(_mm512_ternarylogic_epi32(b, c, d, 0x96), k1);
+
+	__m512i k2 = _mm512_set1_epi32(sha1_k[2]);
+	for (; i < sha1_min(nr_rounds, 60); ++i)
+		SHA1_ROUND(_mm512_ternarylogic_epi32(b, c, d, 0xe8), k2);
+
+	__m512i k3 = _mm512_set1_epi32(sha1_k[3]);
+	for (; i < sha1_min(nr_rounds, 80); ++i)
+		SHA1_ROUND(_mm512_ternarylogic_epi32(b, c, d, 0x96), k3);
+
+#undef SHA1_ROUND
+
+	_mm512_storeu_si512((void *) s.h[0], _mm512_add_epi32(_mm512_loadu_si512((const void *) s.h[0]), a));
+	_mm512_storeu_si512((void *) s.h[1], _mm512_add_epi32(_mm512_loadu_si512((const void *) s.h[1]), b));
+	_mm512_storeu_si512((void *) s.h[2], _mm512_add_epi32(_mm512_loadu_si512((const void *) s.h[2]), c));
+	_mm512_storeu_si512((void *) s.h[3], _mm512_add_epi32(_mm512_loadu_si512((const void *) s.h[3]), d));
+	_mm512_storeu_si512((void *) s.h[4], _mm512_add_epi32(_mm512_loadu_si512((const void *) s.h[4]), e));
+}
+
+/*
+ * SHA extensions: 4 rounds per instruction, one block at a time. Only
+ * usable when the number of rounds is a non-zero multiple of 4.
+ */
+
+#define SHA1_NI_GROUP(func) \
+	do { \
+		if (g >= 4) \
+			msg[g % 4] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(msg[g % 4], msg[(g + 1) % 4]), msg[(g + 2) % 4]), msg[(g + 3) % 4]); \
+		__m128i e1 = g ? _mm_sha1nexte_epu32(e, msg[g % 4]) : _mm_add_epi32(e, msg[0]); \
+		e = abcd; \
+		abcd = _mm_sha1rnds4_epu32(abcd, e1, func); \
+	} while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_compress_shani(unsigned int nr_rounds, uint32_t h[5], const uint32_t w[16])
+{
+	/* sha1rnds4 wants a in the most significant lane */
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) h), 0x1b);
+	__m128i e = _mm_set_epi32(h[4], 0, 0, 0);
+
+	__m128i abcd_save = abcd;
+	__m128i e_save = e;
+
+	__m128i msg[4];
+	for (unsigned int i = 0; i < 4; ++i)
+		msg[i] = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &w[4 * i]), 0x1b);
+
+	unsigned int nr_groups = nr_rounds / 4;
+
+	unsigned int g = 0;
+	for (; g < sha1_min(nr_groups, 5); ++g)
+		SHA1_NI_GROUP(0);
+	for (; g < sha1_min(nr_groups, 10); ++g)
+		SHA1_NI_GROUP(1);
+	for (; g < sha1_min(nr_groups, 15); ++g)
+		SHA1_NI_GROUP(2);
+	for (; g < sha1_min(nr_groups, 20); ++g)
+		SHA1_NI_GROUP(3);
+
+	/* e is now a from 4 rounds ago, which is rotated into place */
+	e = _mm_sha1nexte_epu32(e, e_save);
+
+	abcd = _mm_shuffle_epi32(_mm_add_epi32(abcd, abcd_save), 0x1b);
+	_mm_storeu_si128((__m128i *) h, abcd);
+	h[4] = _mm_extract_epi32(e, 3);
+}
+
+#undef SHA1_NI_GROUP
+
+#endif
+
+/*
+ * Dispatch
+ */
+
+enum sha1_kernel {
+	SHA1_KERNEL_SCALAR,
+	SHA1_KERNEL_AVX2,
+	SHA1_KERNEL_AVX512,
+	SHA1_KERNEL_SHANI,
+};
+
+struct sha1_cpu {
+	bool avx2;
+	bool avx512;
+	bool shani;
+};
+
+/* The features of this CPU, restricted by $SHA1_KERNEL */
+static inline sha1_cpu sha1_detect_cpu()
+{
+	sha1_cpu cpu;
+	memset(&cpu, 0, sizeof(cpu));
+
+#ifdef SHA1_X86
+	__builtin_cpu_init();
+	cpu.avx2 = __builtin_cpu_supports("avx2");
+	cpu.avx512 = __builtin_cpu_supports("avx512f");
+
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		cpu.shani = (ebx >> 29) & 1 && __builtin_cpu_supports("sse4.1");
+#endif
+
+	const char *env = getenv("SHA1_KERNEL");
+	if (!env) {
+	} else if (!strcmp(env, "scalar")) {
+		cpu.avx2 = cpu.avx512 = cpu.shani = false;
+	} else if (!strcmp(env, "avx2")) {
+		cpu.avx512 = cpu.shani = false;
+	} else if (!strcmp(env, "avx512")) {
+		cpu.shani = false;
+	} else if (!strcmp(env, "shani")) {
+		cpu.avx2 = cpu.avx512 = false;
+	}
+
+	return cpu;
+}
+
+/* Detected once; the initialisation of a local static is thread-safe, so
+ * worker threads may call this on first use */
+static inline const sha1_cpu &sha1_cpu_features()
+{
+	static const sha1_cpu cpu = sha1_detect_cpu();
+	return cpu;
+}
+
+static const char *const sha1_kernel_names[] = {
+	"scalar",
+	"avx2",
+	"avx512",
+	"shani",
+};
+
+/* The kernel used by sha1_compress_lanes() */
+static inline sha1_kernel sha1_lanes_kernel()
+{
+	const sha1_cpu &cpu = sha1_cpu_features();
+
+	if (cpu.avx512)
+		return SHA1_KERNEL_AVX512;
+	if (cpu.avx2)
+		return SHA1_KERNEL_AVX2;
+
+	return SHA1_KERNEL_SCALAR;
+}
+
+static inline void sha1_compress(unsigned int nr_rounds, uint32_t h[5], const uint32_t w[16])
+{
+#ifdef SHA1_X86
+	if (nr_rounds && nr_rounds % 4 == 0 && sha1_cpu_features().shani) {
+		sha1_compress_shani(nr_rounds, h, w);
+		return;
+	}
+#endif
+
+	sha1_compress_scalar(nr_rounds, h, w);
+}
+
+static inline void sha1_compress_lanes(unsigned int nr_rounds, sha1_lanes &s)
+{
+	switch (sha1_lanes_kernel()) {
+#ifdef SHA1_X86
+	case SHA1_KERNEL_AVX512:
+		sha1_compress_lanes_avx512(nr_rounds, s);
+		break;
+	case SHA1_KERNEL_AVX2:
+		sha1_compress_lanes_avx2(nr_rounds, s);
+		break;
+#endif
+	default:
+		sha1_compress_lanes_scalar(nr_rounds, s);
+		break;
+	}
+}
+
+/* Full 80-round SHA-1 (with padding) of a byte string, e.g. for cache
+ * keys; incremental so that files can be hashed in pieces */
+class sha1_digest {
+public:
+	sha1_digest():
+		nr_bytes(0),
+		nr_buffered(0)
+	{
+		memcpy(h, sha1_iv, sizeof(h));
+	}
+
+	void update(const void *data, size_t n)
+	{
+		const unsigned char *p = (const unsigned char *) data;
+
+		nr_bytes += n;
+		while (n) {
+			size_t len = 64 - nr_buffered;
+			if (len > n)
+				len = n;
+
+			memcpy(buffer + nr_buffered, p, len);
+			nr_buffered += len;
+			p += len;
+			n -= len;
+
+			if (nr_buffered == 64)
+				block();
+		}
+	}
+
+	/* 40 lowercase hex digits */
+	std::string hex()
+	{
+		uint64_t nr_bits = nr_bytes * 8;
+
+		unsigned char pad = 0x80;
+		update(&pad, 1);
+
+		pad = 0;
+		while (nr_buffered != 56)
+			update(&pad, 1);
+
+		for (unsigned int i = 0; i < 8; ++i)
+			buffer[56 + i] = nr_bits >> (56 - 8 * i);
+		block();
+
+		std::string r;
+		for (unsigned int i = 0; i < 5; ++i) {
+			for (unsigned int j = 0; j < 8; ++j)
+				r += "0123456789abcdef"[(h[i] >> (28 - 4 * j)) & 15];
+		}
+
+		return r;
+	}
+
+private:
+	uint32_t h[5];
+	uint64_t nr_bytes;
+	unsigned int nr_buffered;
+	unsigned char buffer[64];
+
+	void block()
+	{
+		uint32_t w[16];
+		for (unsigned int i = 0; i < 16; ++i) {
+			w[i] = (uint32_t) buffer[4 * i] << 24 | (uint32_t) buffer[4 * i + 1] << 16
+				| (uint32_t) buffer[4 * i + 2] << 8 | buffer[4 * i + 3];
+		}
+
+		sha1_compress(80, h, w);
+		nr_buffered = 0;
+	}
+};
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef SMT2_HH
+#define SMT2_HH
+
+/*
+ * 32-bit bit-vector terms, written as SMT-LIB 2 (QF_BV) for --smt2.
+ *
+ * Every term carries its text and its value under one assignment of the
+ * declared words (the planted message, with --check), so that the
+ * assertions can be checked while they are written. Named terms are
+ * written as define-fun and referred to by name, which keeps the file
+ * linear in the number of rounds. Symbols are quoted (|w[3]|) so they can
+ * have the same names as the variables of the CNF instances.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* The value of a 1-bit term (extract(), bit()) is 0 or 1 */
+struct bv_term {
+	std::string text;
+	uint32_t value;
+};
+
+class smt2 {
+public:
+	smt2():
+		satisfied(true)
+	{
+		out << "(set-option :produce-models true)\n";
+		out << "(set-logic QF_BV)\n";
+	}
+
+	/* Whether every assertion holds for the values of the terms */
+	bool satisfied;
+
+	void comment(const std::string &s)
+	{
+		out << "; " << s << "\n";
+	}
+
+	bv_term constant(uint32_t value)
+	{
+		char buf[16];
+		snprintf(buf, sizeof(buf), "#x%08x", value);
+		return bv_term{buf, value};
+	}
+
+	bv_term declare(const std::string &name, uint32_t value)
+	{
+		out << "(declare-fun |" << name << "| () (_ BitVec 32))\n";
+		return bv_term{"|" + name + "|", value};
+	}
+
+	bv_term define(const std::string &name, const bv_term &t)
+	{
+		out << "(define-fun |" << name << "| () (_ BitVec 32) " << t.text << ")\n";
+		return bv_term{"|" + name + "|", t.value};
+	}
+
+	/* bvxor, bvand and bvadd are left-associative, so they take any
+	 * number of arguments */
+	bv_term bvxor(std::initializer_list<bv_term> args)
+	{
+		uint32_t value = 0;
+		for (const bv_term &t: args)
+			value ^= t.value;
+		return apply("bvxor", args, value);
+	}
+
+	bv_term bvand(std::initializer_list<bv_term> args)
+	{
+		uint32_t value = ~0U;
+		for (const bv_term &t: args)
+			value &= t.value;
+		return apply("bvand", args, value);
+	}
+
+	bv_term bvadd(std::initializer_list<bv_term> args)
+	{
+		uint32_t value = 0;
+		for (const bv_term &t: args)
+			value += t.value;
+		return apply("bvadd", args, value);
+	}
+
+	bv_term rotate_left(unsigned int n, const bv_term &t)
+	{
+		n %= 32;
+		if (n == 0)
+			return t;
+
+		uint32_t value = (t.value << n) | (t.value >> (32 - n));
+		return bv_term{"((_ rotate_left " + std::to_string(n) + ") " + t.text + ")", value};
+	}
+
+	bv_term extract(const bv_term &t, unsigned int bit)
+	{
+		std::string i = std::to_string(bit);
+		return bv_term{"((_ extract " + i + " " + i + ") " + t.text + ")", (t.value >> bit) & 1};
+	}
+
+	bv_term bit(bool value)
+	{
+		return bv_term{value ? "#b1" : "#b0", value};
+	}
+
+	void assert_equal(const bv_term &a, const bv_term &b)
+	{
+		out << "(assert (= " << a.text << " " << b.text << "))\n";
+		satisfied = satisfied && a.value == b.value;
+	}
+
+	void assert_distinct(const bv_term &a, const bv_term &b)
+	{
+		out << "(assert (distinct " << a.text << " " << b.text << "))\n";
+		satisfied = satisfied && a.value != b.value;
+	}
+
+	/* Ask for the values of the given terms after (check-sat) */
+	std::string str(const std::vector<bv_term> &model)
+	{
+		std::ostringstream r;
+		r << out.str();
+		r << "(check-sat)\n";
+
+		if (!model.empty()) {
+			r << "(get-value (";
+			for (unsigned int i = 0; i < model.size(); ++i)
+				r << (i ? " " : "") << model[i].text;
+			r << "))\n";
+		}
+
+		r << "(exit)\n";
+		return r.str();
+	}
+
+private:
+	std::ostringstream out;
+
+	bv_term apply(const char *op, std::initializer_list<bv_term> args, uint32_t value)
+	{
+		if (args.size() == 1)
+			return *args.begin();
+
+		std::string text = "(";
+		text += op;
+		for (const bv_term &t: args)
+			text += " " + t.text;
+		text += ")";
+
+		return bv_term{text, value};
+	}
+};
+
+#endif
@@ -0,0 +1,702 @@
+#ifndef SOLUTION_HH
+#define SOLUTION_HH
+
+/*
+ * Reading instances, symbol maps and solver output for verification.
+ *
+ * Everything here works directly on mmap()ed files with hand-written
+ * scanners, since verifying a result should take a lot less time than
+ * the solver took to produce it.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include "format.hh"
+#include "sha1.hh"
+
+class mapped_file {
+public:
+	const char *data;
+	size_t size;
+
+	mapped_file(const std::string &filename):
+		data(0),
+		size(0)
+	{
+		int fd = open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			throw std::runtime_error(format("$: could not open", filename));
+
+		struct stat st;
+		if (fstat(fd, &st) == -1) {
+			close(fd);
+			throw std::runtime_error(format("$: could not stat", filename));
+		}
+
+		size = st.st_size;
+		if (size) {
+			void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error(format("$: could not mmap", filename));
+			}
+
+			madvise(p, size, MADV_SEQUENTIAL);
+			data = (const char *) p;
+		}
+
+		close(fd);
+	}
+
+	~mapped_file()
+	{
+		if (size)
+			munmap((void *) data, size);
+	}
+
+	const char *begin() const
+	{
+		return data;
+	}
+
+	const char *end() const
+	{
+		return data + size;
+	}
+
+private:
+	mapped_file(const mapped_file &);
+	mapped_file &operator=(const mapped_file &);
+};
+
+static const char *skip_line(const char *p, const char *end)
+{
+	const char *nl = (const char *) memchr(p, '\n', end - p);
+	return nl ? nl + 1 : end;
+}
+
+static const char *skip_space(const char *p, const char *end)
+{
+	while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		++p;
+	return p;
+}
+
+static bool starts_with(const char *p, const char *end, const char *prefix)
+{
+	size_t n = strlen(prefix);
+	return (size_t) (end - p) >= n && !memcmp(p, prefix, n);
+}
+
+static const char *parse_uint(const char *p, const char *end, unsigned long &x)
+{
+	if (p == end || *p < '0' || *p > '9')
+		throw std::runtime_error("expected number");
+
+	x = 0;
+	while (p != end && *p >= '0' && *p <= '9')
+		x = 10 * x + (*p++ - '0');
+
+	return p;
+}
+
+/* Find "key": in a line of JSON written by the generator */
+static const char *json_field(const char *p, const char *end, const char *key)
+{
+	std::string pattern = format("\"$\": ", key);
+
+	while (p != end) {
+		const char *q = (const char *) memchr(p, '"', end - p);
+		if (!q)
+			return 0;
+
+		if (starts_with(q, end, pattern.c_str()))
+			return q + pattern.size();
+
+		p = q + 1;
+	}
+
+	return 0;
+}
+
+static std::string json_string_field(const char *p, const char *end, const char *key)
+{
+	const char *q = json_field(p, end, key);
+	if (!q || q == end || *q != '"')
+		throw std::runtime_error(format("malformed symbol map (expected \"$\")", key));
+
+	const char *value_end = (const char *) memchr(q + 1, '"', end - q - 1);
+	if (!value_end)
+		throw std::runtime_error("malformed symbol map");
+
+	return std::string(q + 1, value_end);
+}
+
+static unsigned long json_uint_field(const char *p, const char *end, const char *key)
+{
+	const char *q = json_field(p, end, key);
+	if (!q)
+		throw std::runtime_error(format("malformed symbol map (expected \"$\")", key));
+
+	unsigned long x;
+	parse_uint(q, end, x);
+	return x;
+}
+
+/* The elements of "key": [...], without quotes */
+static std::vector<std::string> json_list_field(const char *p, const char *end, const char *key)
+{
+	const char *q = json_field(p, end, key);
+	if (!q || q == end || *q != '[')
+		throw std::runtime_error(format("malformed symbol map (expected \"$\")", key));
+
+	const char *list_end = (const char *) memchr(q, ']', end - q);
+	if (!list_end)
+		throw std::runtime_error("malformed symbol map");
+
+	std::vector<std::string> r;
+	for (++q; q < list_end; ) {
+		const char *element_end = (const char *) memchr(q, ',', list_end - q);
+		if (!element_end)
+			element_end = list_end;
+
+		const char *a = skip_space(q, element_end);
+		const char *b = element_end;
+		while (b != a && (b[-1] == ' ' || b[-1] == '"'))
+			--b;
+		if (a != b && *a == '"')
+			++a;
+
+		if (a != b)
+			r.push_back(std::string(a, b));
+		q = element_end + 1;
+	}
+
+	return r;
+}
+
+enum constraint_type {
+	CONSTRAINT_FIXED,
+	CONSTRAINT_EQUAL,
+	CONSTRAINT_DIFFER,
+	CONSTRAINT_ONE_OF,
+};
+
+/* A message or hash bit fixed by the attack (see preimage() etc.), or
+ * for --targets, hash bits that must equal those of one of the hashes */
+struct map_constraint {
+	constraint_type type;
+	std::string name;
+	std::string other;
+	unsigned int bit;
+	bool value;
+
+	/* CONSTRAINT_ONE_OF: bit 32 * i + j is bit j of word <name><i>, and
+	 * hashes has 5 words per hash */
+	std::vector<unsigned int> bits;
+	std::vector<uint32_t> hashes;
+};
+
+/* --targets lists, from the map or a comment */
+static void parse_one_of(map_constraint &c, const std::vector<std::string> &bits, const std::vector<std::string> &hashes)
+{
+	c.type = CONSTRAINT_ONE_OF;
+	c.bit = 0;
+	c.value = false;
+
+	for (const std::string &b: bits) {
+		unsigned long x;
+		if (parse_uint(b.data(), b.data() + b.size(), x) != b.data() + b.size() || x >= 160)
+			throw std::runtime_error(format("malformed hash bit $", b));
+		c.bits.push_back(x);
+	}
+
+	for (const std::string &h: hashes) {
+		if (h.size() != 40 || h.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+			throw std::runtime_error(format("malformed target hash $", h));
+
+		for (unsigned int i = 0; i < 5; ++i)
+			c.hashes.push_back(strtoul(h.substr(8 * i, 8).c_str(), 0, 16));
+	}
+}
+
+static std::vector<std::string> split_list(const std::string &s)
+{
+	std::vector<std::string> r;
+	size_t i = 0;
+	while (i <= s.size()) {
+		size_t j = s.find(',', i);
+		if (j == std::string::npos)
+			j = s.size();
+		if (j > i)
+			r.push_back(s.substr(i, j - i));
+		i = j + 1;
+	}
+
+	return r;
+}
+
+/* Variable names and parameters of an instance */
+class symbol_table {
+public:
+	std::string attack;
+	unsigned int nr_rounds;
+	unsigned long seed;
+	bool have_seed;
+	unsigned int nr_variables;
+	std::map<std::string, int> vars;
+
+	/* From the symbol map or the "constraint" comments of the instance */
+	bool have_constraints;
+	std::vector<map_constraint> constraints;
+
+	symbol_table():
+		nr_rounds(0),
+		seed(0),
+		have_seed(false),
+		nr_variables(0),
+		have_constraints(false)
+	{
+	}
+
+	bool has(const std::string &name) const
+	{
+		return vars.find(name) != vars.end();
+	}
+
+	int var(const std::string &name) const
+	{
+		auto it = vars.find(name);
+		if (it == vars.end())
+			throw std::runtime_error(format("no variable named $", name));
+
+		return it->second;
+	}
+
+	/* Accepts either a symbol map written with --map or the instance
+	 * itself, in which case the "var" comments are used. */
+	void load(const std::string &filename)
+	{
+		mapped_file f(filename);
+
+		const char *p = skip_space(f.begin(), f.end());
+		if (p != f.end() && *p == '{')
+			load_map(p, f.end());
+		else
+			load_instance(p, f.end());
+
+		if (!nr_rounds)
+			throw std::runtime_error(format("$: number of rounds not found", filename));
+	}
+
+private:
+	void load_map(const char *p, const char *end)
+	{
+		while (p != end) {
+			const char *line = skip_space(p, end);
+			p = skip_line(line, end);
+
+			if (starts_with(line, p, "{\"name\": \"")) {
+				const char *name = line + strlen("{\"name\": \"");
+				const char *name_end = (const char *) memchr(name, '"', p - name);
+				if (!name_end || !starts_with(name_end, p, "\", \"first\": "))
+					throw std::runtime_error("malformed symbol map");
+
+				unsigned long first;
+				parse_uint(name_end + strlen("\", \"first\": "), p, first);
+				vars[std::string(name, name_end)] = first;
+			} else if (starts_with(line, p, "{\"type\": \"")) {
+				std::string type = json_string_field(line, p, "type");
+
+				map_constraint c;
+				c.name = json_string_field(line, p, "name");
+				c.bit = 0;
+				c.value = false;
+				if (type != "one_of")
+					c.bit = json_uint_field(line, p, "bit");
+
+				if (type == "one_of") {
+					parse_one_of(c, json_list_field(line, p, "bits"), json_list_field(line, p, "hashes"));
+				} else if (type == "fixed") {
+					c.type = CONSTRAINT_FIXED;
+					c.value = json_uint_field(line, p, "value");
+				} else if (type == "equal") {
+					c.type = CONSTRAINT_EQUAL;
+					c.other = json_string_field(line, p, "other");
+				} else if (type == "differ") {
+					c.type = CONSTRAINT_DIFFER;
+					c.other = json_string_field(line, p, "other");
+				} else {
+					throw std::runtime_error(format("unknown constraint type $", type));
+				}
+
+				constraints.push_back(c);
+			} else if (starts_with(line, p, "\"constraints\": [")) {
+				have_constraints = true;
+			} else if (starts_with(line, p, "\"attack\": \"")) {
+				const char *value = line + strlen("\"attack\": \"");
+				const char *value_end = (const char *) memchr(value, '"', p - value);
+				if (!value_end)
+					throw std::runtime_error("malformed symbol map");
+
+				attack = std::string(value, value_end);
+			} else if (starts_with(line, p, "\"nr_rounds\": ")) {
+				unsigned long x;
+				parse_uint(line + strlen("\"nr_rounds\": "), p, x);
+				nr_rounds = x;
+			} else if (starts_with(line, p, "\"seed\": ")) {
+				parse_uint(line + strlen("\"seed\": "), p, seed);
+				have_seed = true;
+			} else if (starts_with(line, p, "\"nr_variables\": ")) {
+				unsigned long x;
+				parse_uint(line + strlen("\"nr_variables\": "), p, x);
+				nr_variables = x;
+			}
+		}
+	}
+
+	void load_instance(const char *p, const char *end)
+	{
+		unsigned long nr_constraints = 0;
+
+		while (p != end) {
+			const char *line = p;
+			p = skip_line(line, end);
+
+			if (*line != 'c' && *line != '*' && *line != 'p')
+				continue;
+
+			const char *q = line + 1;
+			const char *eol = p;
+			while (eol != line && (eol[-1] == '\n' || eol[-1] == '\r'))
+				--eol;
+
+			if (*line == 'p') {
+				/* p cnf <variables> <clauses> */
+				q = skip_space(q, eol);
+				if (starts_with(q, eol, "cnf")) {
+					unsigned long x;
+					parse_uint(skip_space(q + 3, eol), eol, x);
+					nr_variables = x;
+				}
+			} else if (starts_with(q, eol, " var ")) {
+				/* c var <first>/<width> <name> */
+				unsigned long first;
+				q = parse_uint(q + strlen(" var "), eol, first);
+				q = (const char *) memchr(q, ' ', eol - q);
+				if (!q)
+					throw std::runtime_error("malformed var comment");
+
+				vars[std::string(q + 1, eol)] = first;
+			} else if (starts_with(q, eol, " parameter nr_rounds = ")) {
+				unsigned long x;
+				parse_uint(q + strlen(" parameter nr_rounds = "), eol, x);
+				nr_rounds = x;
+			} else if (starts_with(q, eol, " parameter seed = ")) {
+				parse_uint(q + strlen(" parameter seed = "), eol, seed);
+				have_seed = true;
+			} else if (starts_with(q, eol, " #variable= ")) {
+				unsigned long x;
+				parse_uint(q + strlen(" #variable= "), eol, x);
+				nr_variables = x;
+			} else if (starts_with(q, eol, " constraint ")) {
+				/* c constraint fixed <name> <bit> <value>,
+				 * c constraint equal|differ <name> <other> <bit> or
+				 * c constraint one_of <name> <bits> <hashes> */
+				std::vector<std::string> fields = split_fields(q + strlen(" constraint "), eol);
+				if (fields.size() != 4)
+					throw std::runtime_error("malformed constraint comment");
+
+				map_constraint c;
+				c.name = fields[1];
+				c.value = false;
+
+				unsigned long x;
+				if (fields[0] == "one_of") {
+					parse_one_of(c, split_list(fields[2]), split_list(fields[3]));
+				} else if (fields[0] == "fixed") {
+					c.type = CONSTRAINT_FIXED;
+					parse_uint(fields[2].data(), fields[2].data() + fields[2].size(), x);
+					c.bit = x;
+					parse_uint(fields[3].data(), fields[3].data() + fields[3].size(), x);
+					c.value = x;
+				} else if (fields[0] == "equal" || fields[0] == "differ") {
+					c.type = fields[0] == "equal" ? CONSTRAINT_EQUAL : CONSTRAINT_DIFFER;
+					c.other = fields[2];
+					parse_uint(fields[3].data(), fields[3].data() + fields[3].size(), x);
+					c.bit = x;
+				} else {
+					throw std::runtime_error(format("unknown constraint type $", fields[0]));
+				}
+
+				constraints.push_back(c);
+			} else if (starts_with(q, eol, " constraints ")) {
+				parse_uint(q + strlen(" constraints "), eol, nr_constraints);
+				have_constraints = true;
+			}
+		}
+
+		if (have_constraints && constraints.size() != nr_constraints)
+			throw std::runtime_error("constraint comments are incomplete");
+	}
+
+	static std::vector<std::string> split_fields(const char *p, const char *end)
+	{
+		std::vector<std::string> fields;
+		while ((p = skip_space(p, end)) != end) {
+			const char *q = p;
+			while (q != end && *q != ' ' && *q != '\t')
+				++q;
+
+			fields.push_back(std::string(p, q));
+			p = q;
+		}
+
+		return fields;
+	}
+};
+
+enum solver_status {
+	STATUS_UNKNOWN,
+	STATUS_SAT,
+	STATUS_UNSAT,
+};
+
+/* Assignment read from solver output; values[v] is -1 for variables the
+ * solver did not mention. */
+class model {
+public:
+	solver_status status;
+	std::vector<int8_t> values;
+
+	model():
+		status(STATUS_UNKNOWN)
+	{
+	}
+
+	bool value(int var) const
+	{
+		return var > 0 && (unsigned int) var < values.size() && values[var] == 1;
+	}
+
+	uint32_t word(int first) const
+	{
+		uint32_t x = 0;
+		for (unsigned int i = 0; i < 32; ++i)
+			x |= uint32_t(value(first + i)) << i;
+
+		return x;
+	}
+
+	/* Understands minisat result files ("SAT" followed by the literals),
+	 * competition output ("s SATISFIABLE" followed by "v" lines) and
+	 * pseudo-boolean solver output (literals written as x<n>/-x<n>). */
+	void load(const std::string &filename)
+	{
+		mapped_file f(filename);
+		parse(f.begin(), f.end());
+	}
+
+	void parse(const char *p, const char *end)
+	{
+		while (p != end) {
+			const char *line = skip_space(p, end);
+			p = skip_line(line, end);
+
+			const char *eol = p;
+			while (eol != line && (eol[-1] == '\n' || eol[-1] == '\r'))
+				--eol;
+
+			if (line == eol || *line == 'c' || *line == '*' || *line == 'o')
+				continue;
+
+			if (*line == 's') {
+				const char *q = skip_space(line + 1, eol);
+				if (starts_with(q, eol, "UNSAT"))
+					status = STATUS_UNSAT;
+				else if (starts_with(q, eol, "SAT") || starts_with(q, eol, "OPTIMUM"))
+					status = STATUS_SAT;
+				continue;
+			}
+
+			if (starts_with(line, eol, "UNSAT")) {
+				status = STATUS_UNSAT;
+				continue;
+			}
+
+			if (starts_with(line, eol, "SAT")) {
+				status = STATUS_SAT;
+				continue;
+			}
+
+			if (starts_with(line, eol, "INDET") || starts_with(line, eol, "UNKNOWN"))
+				continue;
+
+			if (*line == 'v')
+				++line;
+
+			parse_literals(line, eol);
+		}
+
+		/* Some solvers print nothing but the assignment */
+		if (status == STATUS_UNKNOWN && !values.empty())
+			status = STATUS_SAT;
+	}
+
+private:
+	void parse_literals(const char *p, const char *end)
+	{
+		while (true) {
+			p = skip_space(p, end);
+			if (p == end)
+				break;
+
+			bool negated = false;
+			if (*p == '-' || *p == '~') {
+				negated = true;
+				++p;
+			}
+
+			if (p != end && *p == 'x')
+				++p;
+
+			unsigned long var;
+			p = parse_uint(p, end, var);
+			if (!var)
+				continue;
+
+			if (var >= values.size())
+				values.resize(var + 1, -1);
+
+			values[var] = !negated;
+		}
+	}
+};
+
+/* The message, chaining value and hash output of one copy of the SHA-1
+ * circuit in a model; name is "" for (second) preimage instances and "0"
+ * or "1" for the two copies in collision instances. */
+struct sha1_claim {
+	std::string name;
+	uint32_t w[16];
+	uint32_t h_in[5];
+	uint32_t h_out[5];
+};
+
+static inline std::vector<sha1_claim> read_claims(const symbol_table &symbols, const model &m)
+{
+	std::vector<std::string> names;
+	if (symbols.has("w0[0]") && symbols.has("w1[0]")) {
+		names.push_back("0");
+		names.push_back("1");
+	} else {
+		names.push_back("");
+	}
+
+	std::vector<sha1_claim> claims;
+	for (const std::string &name: names) {
+		sha1_claim c;
+		c.name = name;
+
+		for (unsigned int i = 0; i < 16; ++i)
+			c.w[i] = m.word(symbols.var(format("w$[$]", name, i)));
+		for (unsigned int i = 0; i < 5; ++i)
+			c.h_in[i] = m.word(symbols.var(format("h$_in$", name, i)));
+		for (unsigned int i = 0; i < 5; ++i)
+			c.h_out[i] = m.word(symbols.var(format("h$_out$", name, i)));
+
+		claims.push_back(c);
+	}
+
+	return claims;
+}
+
+static inline bool matches_one_of(const symbol_table &symbols, const model &m, const map_constraint &c)
+{
+	std::vector<int> words;
+	for (unsigned int i = 0; i < 5; ++i)
+		words.push_back(symbols.var(format("$$", c.name, i)));
+
+	for (unsigned int i = 0; i + 5 <= c.hashes.size(); i += 5) {
+		bool match = true;
+		for (unsigned int b: c.bits) {
+			bool x = m.value(words[b / 32] + b % 32);
+			match = match && x == ((c.hashes[i + b / 32] >> (b % 32)) & 1);
+		}
+
+		if (match)
+			return true;
+	}
+
+	return false;
+}
+
+/* Check the claims against the hashes actually computed from their
+ * messages (hashes[i] belongs to claims[i]) and check the constraints of
+ * the attack. Returns an empty string if the solution is correct and the
+ * reason it is not otherwise. */
+static inline std::string check_claims(const symbol_table &symbols, const model &m,
+	const std::vector<sha1_claim> &claims, const uint32_t (*hashes)[5])
+{
+	for (unsigned int i = 0; i < claims.size(); ++i) {
+		const sha1_claim &c = claims[i];
+
+		if (memcmp(c.h_in, sha1_iv, sizeof(sha1_iv)))
+			return format("h$_in is not the SHA-1 initial value", c.name);
+
+		for (unsigned int j = 0; j < 5; ++j) {
+			if (c.h_out[j] != hashes[i][j])
+				return format("h$_out$ is incorrect", c.name, j);
+		}
+	}
+
+	if (claims.size() == 2 && !memcmp(claims[0].w, claims[1].w, sizeof(claims[0].w)))
+		return "messages are identical";
+
+	/* A correct hash of some message is not a solution of the attack */
+	if (!symbols.have_constraints)
+		return "the constraints of the attack were not checked (no symbol map or constraint comments)";
+
+	for (const map_constraint &c: symbols.constraints) {
+		if (c.type == CONSTRAINT_ONE_OF) {
+			if (!matches_one_of(symbols, m, c))
+				return format("$ matches none of the $ target hashes", c.name, c.hashes.size() / 5);
+			continue;
+		}
+
+		bool x = m.value(symbols.var(c.name) + c.bit);
+
+		switch (c.type) {
+		case CONSTRAINT_FIXED:
+			if (x != c.value)
+				return format("$ bit $ is not $", c.name, c.bit, c.value ? 1 : 0);
+			break;
+		case CONSTRAINT_EQUAL:
+			if (x != m.value(symbols.var(c.other) + c.bit))
+				return format("$ and $ differ in bit $", c.name, c.other, c.bit);
+			break;
+		case CONSTRAINT_DIFFER:
+			if (x == m.value(symbols.var(c.other) + c.bit))
+				return format("$ and $ agree in bit $", c.name, c.other, c.bit);
+			break;
+		case CONSTRAINT_ONE_OF:
+			break;
+		}
+	}
+
+	return "";
+}
+
+#endif
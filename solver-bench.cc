@@ -0,0 +1,584 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compare encodings by how fast solvers solve them.
+ *
+ * A grid of instances (attack x rounds x encoding x seed) is generated
+ * with main, and every solver is run on every instance in a number of
+ * parallel job slots, each optionally pinned to its own CPU. Solvers get
+ * a CPU time limit and an address space limit through setrlimit() and
+ * are killed if they overrun the wall clock. Every SAT answer is checked
+ * against the symbol map like verify-preimage does.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+extern "C" {
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include "format.hh"
+#include "sha1.hh"
+#include "solution.hh"
+
+struct solver {
+	std::string name;
+
+	/* Shell command; {instance} and {solution} are substituted. If
+	 * {solution} does not appear, standard output is the solution. */
+	std::string command;
+};
+
+struct instance {
+	std::string name;
+	std::string attack;
+	unsigned int nr_rounds;
+	std::string encoding;
+	unsigned long seed;
+	std::string filename;
+	std::string map;
+};
+
+struct job {
+	const instance *i;
+	const solver *s;
+	std::string solution;
+
+	/* sat, unsat, timeout, wrong, unknown or error */
+	std::string status;
+	std::string reason;
+	double cpu_seconds;
+	double wall_seconds;
+	unsigned long max_rss_kb;
+};
+
+struct limits {
+	double timeout;
+	unsigned long memory_mb;
+	bool pin;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string replace_all(std::string s, const std::string &from, const std::string &to)
+{
+	for (size_t i = s.find(from); i != std::string::npos; i = s.find(from, i + to.size()))
+		s.replace(i, from.size(), to);
+
+	return s;
+}
+
+static std::vector<std::string> split(const std::string &s, char sep)
+{
+	std::vector<std::string> v;
+
+	std::istringstream ss(s);
+	std::string x;
+	while (std::getline(ss, x, sep))
+		v.push_back(x);
+
+	return v;
+}
+
+/* Run the generator for one instance of the grid */
+static void generate(const std::string &generator, const std::string &output_format,
+	const std::vector<std::string> &extra_args, const instance &inst)
+{
+	std::vector<std::string> args = {
+		generator,
+		format("--$", output_format),
+		format("--attack=$", inst.attack),
+		format("--rounds=$", inst.nr_rounds),
+		format("--seed=$", inst.seed),
+		format("--map=$", inst.map),
+	};
+
+	if (inst.encoding != "plain") {
+		for (const std::string &flag: split(inst.encoding, '+'))
+			args.push_back(format("--$", flag));
+	}
+
+	args.insert(args.end(), extra_args.begin(), extra_args.end());
+
+	std::vector<char *> argv;
+	for (std::string &arg: args)
+		argv.push_back(&arg[0]);
+	argv.push_back(0);
+
+	int fd = open(inst.filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+		throw std::runtime_error(format("$: could not create", inst.filename));
+
+	pid_t child = fork();
+	if (child == -1)
+		throw std::runtime_error("fork() failed");
+
+	if (child == 0) {
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+
+		execv(argv[0], &argv[0]);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	close(fd);
+
+	int status;
+	if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		throw std::runtime_error(format("generating $ failed", inst.name));
+}
+
+/* Run the solver with resource limits; fills in the times of the job */
+static void run_solver(job &j, const limits &l, int cpu)
+{
+	std::string command = replace_all(j.s->command, "{instance}", j.i->filename);
+	bool to_stdout = command.find("{solution}") == std::string::npos;
+	command = replace_all(command, "{solution}", j.solution);
+
+	auto start = std::chrono::steady_clock::now();
+
+	pid_t child = fork();
+	if (child == -1)
+		throw std::runtime_error("fork() failed");
+
+	if (child == 0) {
+		/* Own process group, so that a timeout kills everything */
+		setpgid(0, 0);
+
+		if (cpu >= 0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu, &set);
+			sched_setaffinity(0, sizeof(set), &set);
+		}
+
+		struct rlimit r;
+		r.rlim_cur = (rlim_t) l.timeout + 1;
+		r.rlim_max = r.rlim_cur + 1;
+		setrlimit(RLIMIT_CPU, &r);
+
+		if (l.memory_mb) {
+			r.rlim_cur = r.rlim_max = (rlim_t) l.memory_mb << 20;
+			setrlimit(RLIMIT_AS, &r);
+		}
+
+		int out = open(to_stdout ? j.solution.c_str() : "/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (out != -1) {
+			dup2(out, STDOUT_FILENO);
+			close(out);
+		}
+
+		int err = open("/dev/null", O_WRONLY);
+		if (err != -1) {
+			dup2(err, STDERR_FILENO);
+			close(err);
+		}
+
+		execl("/bin/sh", "sh", "-c", command.c_str(), (char *) 0);
+		_exit(127);
+	}
+
+	/* The wall clock limit is generous; the CPU limit is the real one */
+	double wall_limit = 2 * l.timeout + 5;
+
+	int status;
+	struct rusage usage;
+	bool killed = false;
+	while (true) {
+		pid_t pid = wait4(child, &status, WNOHANG, &usage);
+		if (pid == -1 && errno == EINTR)
+			continue;
+		if (pid == -1)
+			throw std::runtime_error("wait4() failed");
+		if (pid == child)
+			break;
+
+		if (!killed && seconds_since(start) > wall_limit) {
+			kill(-child, SIGKILL);
+			kill(child, SIGKILL);
+			killed = true;
+		}
+
+		usleep(1000);
+	}
+
+	j.wall_seconds = seconds_since(start);
+	j.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+		+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	j.max_rss_kb = usage.ru_maxrss;
+
+	if (killed || j.cpu_seconds > l.timeout
+		|| (WIFSIGNALED(status) && (WTERMSIG(status) == SIGXCPU || WTERMSIG(status) == SIGKILL)))
+	{
+		j.status = "timeout";
+	}
+}
+
+/* Check the answer the way verify-preimage does */
+static void check_answer(job &j)
+{
+	symbol_table symbols;
+	symbols.load(j.i->map);
+
+	model m;
+	m.load(j.solution);
+
+	if (m.status == STATUS_UNSAT) {
+		/* (Second) preimage instances are satisfiable by construction */
+		if (symbols.attack == "collision") {
+			j.status = "unsat";
+		} else {
+			j.status = "wrong";
+			j.reason = "claimed unsatisfiable";
+		}
+
+		return;
+	}
+
+	if (m.status != STATUS_SAT) {
+		j.status = "unknown";
+		return;
+	}
+
+	std::vector<sha1_claim> claims = read_claims(symbols, m);
+
+	uint32_t hashes[2][5];
+	for (unsigned int i = 0; i < claims.size(); ++i) {
+		memcpy(hashes[i], claims[i].h_in, sizeof(hashes[i]));
+		sha1_compress(symbols.nr_rounds, hashes[i], claims[i].w);
+	}
+
+	std::string error = check_claims(symbols, m, claims, hashes);
+	if (error.empty()) {
+		j.status = "sat";
+	} else {
+		j.status = "wrong";
+		j.reason = error;
+	}
+}
+
+static void worker(std::vector<job> &jobs, std::atomic<size_t> &next, const limits &l,
+	int cpu, std::mutex &lock)
+{
+	while (true) {
+		size_t i = next++;
+		if (i >= jobs.size())
+			break;
+
+		job &j = jobs[i];
+
+		try {
+			run_solver(j, l, cpu);
+			if (j.status.empty())
+				check_answer(j);
+		} catch (const std::exception &e) {
+			j.status = "error";
+			j.reason = e.what();
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		std::cerr << format("$ $: $ ($ s)\n", j.s->name, j.i->name, j.status, j.cpu_seconds);
+	}
+}
+
+static bool solved(const job &j)
+{
+	return j.status == "sat" || j.status == "unsat";
+}
+
+static double median(std::vector<double> v)
+{
+	if (v.empty())
+		return 0;
+
+	std::sort(v.begin(), v.end());
+	if (v.size() % 2)
+		return v[v.size() / 2];
+
+	return (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+}
+
+static std::string json_escape(const std::string &s)
+{
+	std::string r;
+	for (char c: s) {
+		if (c == '"' || c == '\\')
+			r += '\\';
+		if ((unsigned char) c < 0x20)
+			r += format("\\u00$$", "0123456789abcdef"[c >> 4], "0123456789abcdef"[c & 15]);
+		else
+			r += c;
+	}
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string generator = "./main";
+	std::string output_format = "cnf";
+	std::vector<std::string> solver_specs;
+	std::vector<std::string> attacks;
+	std::vector<unsigned int> rounds;
+	std::vector<std::string> encodings;
+	unsigned int nr_seeds = 3;
+	unsigned long first_seed = 1;
+	std::vector<std::string> extra_args;
+	std::string workdir = "solver-bench.d";
+	std::string report;
+	unsigned int nr_jobs = 1;
+	limits l;
+	l.timeout = 60;
+	l.memory_mb = 0;
+	l.pin = false;
+
+	{
+		using namespace boost::program_options;
+
+		options_description options("Options");
+		options.add_options()
+			("help,h", "Display this information")
+			("solver", value<std::vector<std::string>>(&solver_specs), "NAME=COMMAND; {instance} and {solution} are substituted, otherwise standard output is the solution")
+			("generator", value<std::string>(&generator), "Path to the generator")
+			("format", value<std::string>(&output_format), "Instance format (cnf or opb)")
+			("attack", value<std::vector<std::string>>(&attacks), "Attack type; default preimage")
+			("rounds", value<std::vector<unsigned int>>(&rounds), "Number of rounds; default 16, 20, 24")
+			("encoding", value<std::vector<std::string>>(&encodings), "Encoding flags joined by '+', e.g. xor+tseitin-adders, or 'plain'; default plain")
+			("seeds", value<unsigned int>(&nr_seeds), "Number of instances per grid point")
+			("first-seed", value<unsigned long>(&first_seed), "Seed of the first instance")
+			("generator-arg", value<std::vector<std::string>>(&extra_args), "Extra argument for the generator, e.g. --message-bits=448")
+			("timeout", value<double>(&l.timeout), "CPU time limit per job in seconds")
+			("memory", value<unsigned long>(&l.memory_mb), "Address space limit per job in MiB")
+			("jobs", value<unsigned int>(&nr_jobs), "Number of jobs to run in parallel")
+			("pin", "Pin each job slot to its own CPU")
+			("workdir", value<std::string>(&workdir), "Directory for instances and solutions")
+			("report", value<std::string>(&report), "Write the JSON results to this file")
+		;
+
+		variables_map map;
+		store(parse_command_line(argc, argv, options), map);
+		notify(map);
+
+		if (map.count("help")) {
+			std::cout << options;
+			return 0;
+		}
+
+		if (map.count("pin"))
+			l.pin = true;
+	}
+
+	if (solver_specs.empty()) {
+		std::cerr << "Must specify at least one --solver\n";
+		return EXIT_FAILURE;
+	}
+
+	if (output_format != "cnf" && output_format != "opb") {
+		std::cerr << "Invalid --format\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<solver> solvers;
+	for (const std::string &spec: solver_specs) {
+		size_t eq = spec.find('=');
+		if (eq == std::string::npos || eq == 0) {
+			std::cerr << format("Invalid --solver $ (expected NAME=COMMAND)\n", spec);
+			return EXIT_FAILURE;
+		}
+
+		solvers.push_back(solver{spec.substr(0, eq), spec.substr(eq + 1)});
+	}
+
+	if (attacks.empty())
+		attacks = {"preimage"};
+	if (rounds.empty())
+		rounds = {16, 20, 24};
+	if (encodings.empty())
+		encodings = {"plain"};
+	if (!nr_jobs)
+		nr_jobs = 1;
+
+	if (mkdir(workdir.c_str(), 0777) == -1 && errno != EEXIST) {
+		std::cerr << format("$: could not create directory\n", workdir);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<instance> instances;
+	for (const std::string &attack: attacks) {
+		for (unsigned int nr_rounds: rounds) {
+			for (const std::string &encoding: encodings) {
+				for (unsigned int k = 0; k < nr_seeds; ++k) {
+					instance inst;
+					inst.name = format("$-$-$-$", attack, nr_rounds, encoding, first_seed + k);
+					inst.attack = attack;
+					inst.nr_rounds = nr_rounds;
+					inst.encoding = encoding;
+					inst.seed = first_seed + k;
+					inst.filename = format("$/$.$", workdir, inst.name, output_format);
+					inst.map = format("$/$.map", workdir, inst.name);
+					instances.push_back(inst);
+				}
+			}
+		}
+	}
+
+	try {
+		for (const instance &inst: instances)
+			generate(generator, output_format, extra_args, inst);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<job> jobs;
+	for (const instance &inst: instances) {
+		for (const solver &s: solvers) {
+			job j;
+			j.i = &inst;
+			j.s = &s;
+			j.solution = format("$/$.$.sol", workdir, inst.name, s.name);
+			j.cpu_seconds = 0;
+			j.wall_seconds = 0;
+			j.max_rss_kb = 0;
+			jobs.push_back(j);
+		}
+	}
+
+	unsigned int nr_cpus = std::max(1U, std::thread::hardware_concurrency());
+	if (l.pin && nr_jobs > nr_cpus)
+		std::cerr << format("warning: $ job slots share $ CPUs\n", nr_jobs, nr_cpus);
+
+	std::atomic<size_t> next(0);
+	std::mutex lock;
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < nr_jobs; ++i) {
+		int cpu = l.pin ? int(i % nr_cpus) : -1;
+		threads.push_back(std::thread(worker, std::ref(jobs), std::ref(next), std::cref(l), cpu, std::ref(lock)));
+	}
+	for (std::thread &t: threads)
+		t.join();
+
+	/* Summary per (solver, encoding). Unsolved jobs count as twice the
+	 * time limit in the PAR-2 score; the median is over solved jobs. */
+	struct summary {
+		unsigned int nr_jobs = 0;
+		unsigned int nr_solved = 0;
+		unsigned int nr_wrong = 0;
+		double par2 = 0;
+		std::vector<double> times;
+	};
+
+	std::map<std::pair<std::string, std::string>, summary> summaries;
+	for (const job &j: jobs) {
+		summary &s = summaries[std::make_pair(j.s->name, j.i->encoding)];
+
+		++s.nr_jobs;
+		if (solved(j)) {
+			++s.nr_solved;
+			s.par2 += j.cpu_seconds;
+			s.times.push_back(j.cpu_seconds);
+		} else {
+			s.par2 += 2 * l.timeout;
+		}
+
+		if (j.status == "wrong")
+			++s.nr_wrong;
+	}
+
+	unsigned int nr_wrong = 0;
+
+	std::cout << "solver\tencoding\tsolved\twrong\tpar2\tmedian\n";
+	for (auto &it: summaries) {
+		summary &s = it.second;
+		s.par2 /= s.nr_jobs;
+		nr_wrong += s.nr_wrong;
+
+		std::cout << format("$\t$\t$/$\t$\t$\t$\n", it.first.first, it.first.second,
+			s.nr_solved, s.nr_jobs, s.nr_wrong, s.par2, median(s.times));
+	}
+
+	if (!report.empty()) {
+		std::ofstream out(report.c_str());
+
+		out << "{\n";
+		out << format("\t\"timeout\": $,\n", l.timeout);
+		out << format("\t\"memory_mb\": $,\n", l.memory_mb);
+		out << format("\t\"jobs\": $,\n", nr_jobs);
+		out << "\t\"summary\": [\n";
+
+		unsigned int k = 0;
+		for (const auto &it: summaries) {
+			const summary &s = it.second;
+
+			out << format("\t\t{\"solver\": \"$\", \"encoding\": \"$\", \"total\": $, \"solved\": $, \"wrong\": $, \"par2\": $, \"median_seconds\": $}$\n",
+				json_escape(it.first.first), json_escape(it.first.second), s.nr_jobs, s.nr_solved,
+				s.nr_wrong, s.par2, median(s.times), ++k < summaries.size() ? "," : "");
+		}
+
+		out << "\t],\n";
+		out << "\t\"results\": [\n";
+
+		for (unsigned int i = 0; i < jobs.size(); ++i) {
+			const job &j = jobs[i];
+
+			out << format("\t\t{\"solver\": \"$\", \"instance\": \"$\", \"attack\": \"$\", \"nr_rounds\": $, \"encoding\": \"$\", \"status\": \"$\", \"reason\": \"$\", \"cpu_seconds\": $, \"wall_seconds\": $, \"max_rss_kb\": $}$\n",
+				json_escape(j.s->name), json_escape(j.i->filename), j.i->attack, j.i->nr_rounds,
+				json_escape(j.i->encoding), j.status, json_escape(j.reason), j.cpu_seconds,
+				j.wall_seconds, j.max_rss_kb, i + 1 < jobs.size() ? "," : "");
+		}
+
+		out << "\t]\n";
+		out << "}\n";
+
+		if (!out) {
+			std::cerr << format("$: could not write report\n", report);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* A wrong answer is a solver (or encoding) bug */
+	return nr_wrong ? 1 : 0;
+}
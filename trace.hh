@@ -0,0 +1,136 @@
+#ifndef TRACE_HH
+#define TRACE_HH
+
+/*
+ * Timing of the phases of a run, written with --trace.
+ *
+ * A trace_span covers the scope it is declared in. Spans are always
+ * compiled in; the start time is always taken (so that spans opened
+ * before the command line has been parsed still work), but the span is
+ * only recorded if tracing is enabled when it ends. The trace is written
+ * in the Chrome trace event format (chrome://tracing, Perfetto).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "format.hh"
+
+struct trace_event {
+	const char *name;
+	std::vector<std::pair<const char *, long>> args;
+
+	/* Microseconds since trace_epoch */
+	double start;
+	double duration;
+};
+
+static bool trace_enabled = false;
+static const std::chrono::steady_clock::time_point trace_epoch = std::chrono::steady_clock::now();
+static std::vector<trace_event> trace_events;
+
+class trace_span {
+public:
+	trace_span(const char *name):
+		name(name),
+		start(std::chrono::steady_clock::now())
+	{
+	}
+
+	~trace_span()
+	{
+		if (!trace_enabled)
+			return;
+
+		auto end = std::chrono::steady_clock::now();
+
+		trace_event e;
+		e.name = name;
+		e.args = args;
+		e.start = std::chrono::duration<double, std::micro>(start - trace_epoch).count();
+		e.duration = std::chrono::duration<double, std::micro>(end - start).count();
+		trace_events.push_back(e);
+	}
+
+	void arg(const char *key, long value)
+	{
+		if (trace_enabled)
+			args.push_back(std::make_pair(key, value));
+	}
+
+private:
+	const char *name;
+	std::chrono::steady_clock::time_point start;
+	std::vector<std::pair<const char *, long>> args;
+
+	trace_span(const trace_span &);
+	trace_span &operator=(const trace_span &);
+};
+
+static inline void write_trace(const std::string &filename)
+{
+	std::ofstream out(filename.c_str());
+	if (!out)
+		throw std::runtime_error("could not open trace file");
+
+	/* Outer spans first, which is what the viewers expect for spans
+	 * with the same start time */
+	std::vector<trace_event> events = trace_events;
+	std::stable_sort(events.begin(), events.end(), [](const trace_event &a, const trace_event &b) {
+		return a.start < b.start || (a.start == b.start && a.duration > b.duration);
+	});
+
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+	for (unsigned int i = 0; i < events.size(); ++i) {
+		const trace_event &e = events[i];
+
+		/* The default precision of format() is too coarse */
+		char times[64];
+		snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f", e.start, e.duration);
+
+		out << format("{\"name\": \"$\", \"cat\": \"sha1-sat\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, $, \"args\": {",
+			e.name, times);
+
+		for (unsigned int j = 0; j < e.args.size(); ++j)
+			out << format("$\"$\": $", j ? ", " : "", e.args[j].first, e.args[j].second);
+
+		out << format("}}$\n", i + 1 < events.size() ? "," : "");
+	}
+
+	out << "]}\n";
+
+	if (!out)
+		throw std::runtime_error("could not write trace file");
+}
+
+/* Total time and number of spans per phase, slowest first; the time of
+ * a phase includes the phases nested in it */
+static inline void print_trace_summary(std::ostream &out)
+{
+	std::map<std::string, std::pair<unsigned int, double>> phases;
+	for (const trace_event &e: trace_events) {
+		auto &p = phases[e.name];
+		p.first += 1;
+		p.second += e.duration;
+	}
+
+	std::vector<std::pair<double, std::string>> order;
+	for (const auto &it: phases)
+		order.push_back(std::make_pair(it.second.second, it.first));
+	std::sort(order.rbegin(), order.rend());
+
+	out << "phase\tcalls\tms\n";
+	for (const auto &it: order)
+		out << format("$\t$\t$\n", it.second, phases[it.second].first, it.first / 1000);
+}
+
+#endif
@@ -0,0 +1,388 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Verify many (instance, solution) pairs at once.
+ *
+ * Worker threads take pairs from a shared list, parse them, and queue
+ * the messages to be hashed. Messages are hashed SHA1_LANES at a time
+ * (grouped by number of rounds) with the multi-buffer kernel, after which
+ * the remaining checks of check_claims() are done.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+extern "C" {
+#include <dirent.h>
+#include <sys/stat.h>
+}
+
+#include "format.hh"
+#include "sha1.hh"
+#include "solution.hh"
+
+struct job {
+	std::string instance;
+	std::string solution;
+
+	/* pass, fail, unsat, unknown or error */
+	std::string status;
+	std::string reason;
+	double seconds;
+};
+
+/* A job whose messages are waiting to be hashed */
+struct pending_job {
+	job *j;
+
+	symbol_table symbols;
+	model m;
+	std::vector<sha1_claim> claims;
+
+	uint32_t hashes[2][5];
+	unsigned int nr_unhashed;
+};
+
+struct lane_batch {
+	sha1_lanes lanes;
+	std::vector<std::pair<pending_job *, unsigned int>> owners;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void finish(pending_job *p)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	/* A symbol map can name constraint variables that do not exist; this
+	 * runs in a worker thread, where an exception would end the batch */
+	try {
+		std::string error = check_claims(p->symbols, p->m, p->claims, p->hashes);
+		if (error.empty()) {
+			p->j->status = "pass";
+		} else {
+			p->j->status = "fail";
+			p->j->reason = error;
+		}
+	} catch (const std::exception &e) {
+		p->j->status = "error";
+		p->j->reason = e.what();
+	}
+
+	/* Time spent waiting for the rest of the batch is not counted */
+	p->j->seconds += seconds_since(start);
+	delete p;
+}
+
+static void flush(unsigned int nr_rounds, lane_batch &batch)
+{
+	sha1_compress_lanes(nr_rounds, batch.lanes);
+
+	for (unsigned int lane = 0; lane < batch.owners.size(); ++lane) {
+		pending_job *p = batch.owners[lane].first;
+		unsigned int claim = batch.owners[lane].second;
+
+		for (unsigned int i = 0; i < 5; ++i)
+			p->hashes[claim][i] = batch.lanes.h[i][lane];
+
+		if (!--p->nr_unhashed)
+			finish(p);
+	}
+
+	batch.owners.clear();
+}
+
+static void worker(std::vector<job> &jobs, std::atomic<size_t> &next)
+{
+	std::map<unsigned int, lane_batch> batches;
+
+	while (true) {
+		size_t i = next++;
+		if (i >= jobs.size())
+			break;
+
+		job &j = jobs[i];
+		std::unique_ptr<pending_job> p(new pending_job);
+		p->j = &j;
+
+		auto start = std::chrono::steady_clock::now();
+
+		try {
+			p->symbols.load(j.instance);
+			p->m.load(j.solution);
+
+			if (p->m.status != STATUS_SAT) {
+				j.status = p->m.status == STATUS_UNSAT ? "unsat" : "unknown";
+				j.seconds = seconds_since(start);
+				continue;
+			}
+
+			/* The hashes alone do not say whether the attack was
+			 * solved */
+			if (!p->symbols.have_constraints)
+				throw std::runtime_error("the constraints of the attack are unknown (no symbol map or constraint comments)");
+
+			p->claims = read_claims(p->symbols, p->m);
+		} catch (const std::exception &e) {
+			j.status = "error";
+			j.reason = e.what();
+			j.seconds = seconds_since(start);
+			continue;
+		}
+
+		j.seconds = seconds_since(start);
+		p->nr_unhashed = p->claims.size();
+
+		lane_batch &batch = batches[p->symbols.nr_rounds];
+		for (unsigned int k = 0; k < p->claims.size(); ++k) {
+			unsigned int lane = batch.owners.size();
+
+			for (unsigned int l = 0; l < 5; ++l)
+				batch.lanes.h[l][lane] = p->claims[k].h_in[l];
+			for (unsigned int l = 0; l < 16; ++l)
+				batch.lanes.w[l][lane] = p->claims[k].w[l];
+
+			batch.owners.push_back(std::make_pair(p.get(), k));
+			if (batch.owners.size() == SHA1_LANES)
+				flush(p->symbols.nr_rounds, batch);
+		}
+
+		/* Now owned by the batches */
+		p.release();
+	}
+
+	for (auto &it: batches) {
+		if (!it.second.owners.empty())
+			flush(it.first, it.second);
+	}
+}
+
+static bool file_exists(const std::string &filename)
+{
+	struct stat st;
+	return stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static void read_manifest(const std::string &filename, std::vector<job> &jobs)
+{
+	std::ifstream in(filename.c_str());
+	if (!in)
+		throw std::runtime_error(format("$: could not open", filename));
+
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream ss(line);
+
+		job j;
+		if (!(ss >> j.instance) || j.instance[0] == '#')
+			continue;
+		if (!(ss >> j.solution))
+			throw std::runtime_error(format("$: expected instance and solution", filename));
+
+		j.seconds = 0;
+		jobs.push_back(j);
+	}
+}
+
+/* Every <name>.sol in the directory is checked against <name>.map or,
+ * if there is no symbol map, <name>.cnf or <name>.opb, whose "constraint"
+ * comments give the fixed bits. */
+static void read_directory(const std::string &dirname, std::vector<job> &jobs)
+{
+	DIR *dir = opendir(dirname.c_str());
+	if (!dir)
+		throw std::runtime_error(format("$: could not open", dirname));
+
+	std::vector<std::string> names;
+	while (struct dirent *e = readdir(dir)) {
+		std::string name = e->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".sol") == 0)
+			names.push_back(name.substr(0, name.size() - 4));
+	}
+
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	for (const std::string &name: names) {
+		job j;
+		j.solution = format("$/$.sol", dirname, name);
+		j.seconds = 0;
+
+		for (const char *ext: {"map", "cnf", "opb"}) {
+			std::string instance = format("$/$.$", dirname, name, ext);
+			if (file_exists(instance)) {
+				j.instance = instance;
+				break;
+			}
+		}
+
+		if (j.instance.empty()) {
+			j.instance = format("$/$.map", dirname, name);
+			j.status = "error";
+			j.reason = "no instance or symbol map found";
+		}
+
+		jobs.push_back(j);
+	}
+}
+
+static std::string json_escape(const std::string &s)
+{
+	std::string r;
+	for (char c: s) {
+		if (c == '"' || c == '\\')
+			r += '\\';
+		if ((unsigned char) c < 0x20)
+			r += format("\\u00$$", "0123456789abcdef"[c >> 4], "0123456789abcdef"[c & 15]);
+		else
+			r += c;
+	}
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<std::string> manifests;
+	std::vector<std::string> directories;
+	std::string report;
+	unsigned int nr_threads = std::thread::hardware_concurrency();
+
+	{
+		using namespace boost::program_options;
+
+		options_description options("Options");
+		options.add_options()
+			("help,h", "Display this information")
+			("manifest", value<std::vector<std::string>>(&manifests), "File with one \"INSTANCE SOLUTION\" pair per line")
+			("dir", value<std::vector<std::string>>(&directories), "Directory of <name>.sol files next to <name>.map/.cnf/.opb")
+			("threads", value<unsigned int>(&nr_threads), "Number of worker threads")
+			("report", value<std::string>(&report), "Write the JSON report to this file instead of standard output")
+		;
+
+		variables_map map;
+		store(parse_command_line(argc, argv, options), map);
+		notify(map);
+
+		if (map.count("help")) {
+			std::cout << options;
+			return 0;
+		}
+	}
+
+	if (manifests.empty() && directories.empty()) {
+		std::cerr << "Must specify --manifest or --dir\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!nr_threads)
+		nr_threads = 1;
+
+	std::vector<job> jobs;
+	try {
+		for (const std::string &m: manifests)
+			read_manifest(m, jobs);
+		for (const std::string &d: directories)
+			read_directory(d, jobs);
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	/* Jobs that already failed (e.g. missing instance) are skipped by
+	 * moving them out of the way of the workers */
+	std::vector<job> todo;
+	std::vector<job> done;
+	for (const job &j: jobs)
+		(j.status.empty() ? todo : done).push_back(j);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < nr_threads; ++i)
+		threads.push_back(std::thread(worker, std::ref(todo), std::ref(next)));
+	for (std::thread &t: threads)
+		t.join();
+
+	double seconds = seconds_since(start);
+
+	todo.insert(todo.end(), done.begin(), done.end());
+
+	std::map<std::string, unsigned int> counts;
+	for (const char *status: {"pass", "fail", "unsat", "unknown", "error"})
+		counts[status] = 0;
+	for (const job &j: todo)
+		++counts[j.status];
+
+	std::ostringstream out;
+	out << "{\n";
+	out << format("\t\"total\": $,\n", todo.size());
+	for (const char *status: {"pass", "fail", "unsat", "unknown", "error"})
+		out << format("\t\"$\": $,\n", status, counts[status]);
+	out << format("\t\"threads\": $,\n", nr_threads);
+	out << format("\t\"kernel\": \"$\",\n", sha1_kernel_names[sha1_lanes_kernel()]);
+	out << format("\t\"seconds\": $,\n", seconds);
+	out << format("\t\"per_second\": $,\n", seconds > 0 ? todo.size() / seconds : 0);
+	out << "\t\"results\": [\n";
+
+	for (unsigned int i = 0; i < todo.size(); ++i) {
+		const job &j = todo[i];
+
+		out << format("\t\t{\"instance\": \"$\", \"solution\": \"$\", \"status\": \"$\", \"reason\": \"$\", \"seconds\": $}$\n",
+			json_escape(j.instance), json_escape(j.solution), j.status, json_escape(j.reason), j.seconds,
+			i + 1 < todo.size() ? "," : "");
+	}
+
+	out << "\t]\n";
+	out << "}\n";
+
+	if (report.empty()) {
+		std::cout << out.str();
+	} else {
+		std::ofstream f(report.c_str());
+		f << out.str();
+		if (!f) {
+			std::cerr << format("$: could not write report\n", report);
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::cerr << format("$ passed, $ failed, $ unsat, $ unknown, $ errors in $ s\n",
+		counts["pass"], counts["fail"], counts["unsat"], counts["unknown"], counts["error"], seconds);
+
+	return counts["pass"] == todo.size() ? 0 : 1;
+}
@@ -1,86 +1,71 @@
+/*
+ * sha1-sat -- SAT instance generator for SHA-1
+ * Copyright (C) 2011-2012, 2021  Vegard Nossum <vegard.nossum@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
+#include <exception>
+#include <string>
 
-uint32_t rotl(uint32_t x, unsigned int n)
-{
-	return (x << n) | (x >> (32 - n));
-}
-
-void sha1(unsigned int nr_rounds,
-    uint32_t &h0,
-    uint32_t &h1,
-    uint32_t &h2,
-    uint32_t &h3,
-    uint32_t &h4,
-    uint32_t w[80])
-{
-    uint32_t a = h0;
-    uint32_t b = h1;
-    uint32_t c = h2;
-    uint32_t d = h3;
-    uint32_t e = h4;
-
-    for (unsigned int i = 16; i < 80; ++i)
-        w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
-
-    for (unsigned int i = 0; i < nr_rounds; ++i) {
-        uint32_t f, k;
-
-        if (i >= 0 && i < 20) {
-            f = (b & c) | (~b & d);
-            k = uint32_t(0x5a827999U);
-        } else if (i >= 20 && i < 40) {
-            f = b ^ c ^ d;
-            k = uint32_t(0x6ed9eba1U);
-        } else if (i >= 40 && i < 60) {
-            f = (b & c) | (b & d) | (c & d);
-            k = uint32_t(0x8f1bbcdcU);
-        } else if (i >= 60 && i < 80) {
-            f = b ^ c ^ d;
-            k = uint32_t(0xca62c1d6U);
-        }
-
-        uint32_t t = rotl(a, 5) + f + e + k + w[i];
-        e = d;
-        d = c;
-        c = rotl(b, 30);
-        b = a;
-        a = t;
-    }
-
-    h0 = h0 + a;
-    h1 = h1 + b;
-    h2 = h2 + c;
-    h3 = h3 + d;
-    h4 = h4 + e;
-}
+#include "format.hh"
+#include "sha1.hh"
+#include "solution.hh"
 
 int main(int argc, char *argv[])
 {
-	unsigned int nr_rounds;
-	scanf("%u", &nr_rounds);
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s INSTANCE|MAP SOLUTION\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	try {
+		symbol_table symbols;
+		symbols.load(argv[1]);
 
-	uint32_t w[80];
-	for (unsigned int i = 0; i < 16; ++i)
-		scanf("%08x", &w[i]);
+		model m;
+		m.load(argv[2]);
 
-	uint32_t H[5];
-	for (unsigned int i = 0; i < 5; ++i)
-		scanf("%08x", &H[i]);
+		if (m.status != STATUS_SAT) {
+			printf("no solution\n");
+			exit(EXIT_FAILURE);
+		}
 
-	uint32_t h[5];
-	for (unsigned int i = 0; i < 5; ++i)
-		scanf("%08x", &h[i]);
+		std::vector<sha1_claim> claims = read_claims(symbols, m);
 
-	sha1(nr_rounds, H[0], H[1], H[2], H[3], H[4], w);
+		uint32_t hashes[2][5];
+		for (unsigned int i = 0; i < claims.size(); ++i) {
+			memcpy(hashes[i], claims[i].h_in, sizeof(hashes[i]));
+			sha1_compress(symbols.nr_rounds, hashes[i], claims[i].w);
 
-	for (unsigned int i = 0; i < 5; ++i)
-		printf("%08x %08x %s\n", h[i], H[i], h[i] == H[i] ? "correct" : "incorrect");
+			for (unsigned int j = 0; j < 5; ++j) {
+				printf("%08x %08x %s\n", claims[i].h_out[j], hashes[i][j],
+					claims[i].h_out[j] == hashes[i][j] ? "correct" : "incorrect");
+			}
+		}
 
-	for (unsigned int i = 0; i < 5; ++i) {
-		if (h[i] != H[i])
+		std::string error = check_claims(symbols, m, claims, hashes);
+		if (!error.empty()) {
+			printf("%s\n", error.c_str());
 			exit(EXIT_FAILURE);
+		}
+	} catch (const std::exception &e) {
+		fprintf(stderr, "%s: %s\n", argv[0], e.what());
+		exit(EXIT_FAILURE);
 	}
 
 	return 0;